@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/database.h"
+
+/*
+ * Lease churn on a multicast-like pool, with the default allocator and in
+ * buddy mode. Every operation takes a new lease, mostly masks of 2^16 to
+ * 2^22 addresses and one in eight a small set of up to 4096, after
+ * releasing random leases until it fits in 90% of the pool. Reports the
+ * time per operation, the mask requests that only got a smaller block,
+ * and the number of free sets left in the tree.
+ */
+
+#define POOL_ADDR		0x1ACB00000000
+#define MAX_LEASES		4096
+#define OPS				1000000
+
+struct Result
+{
+	double ns;
+	uint64_t short_blocks;
+	uint64_t free_sets;
+};
+
+static Result run(uint64_t pool_size, bool buddy)
+{
+	Palma protocol;
+	SetDatabase db(&protocol);
+	AddrSet pool(POOL_ADDR, pool_size);
+	AssignableSet **leases = new AssignableSet *[MAX_LEASES];
+	uint64_t leased = 0;
+	int n = 0;
+	Result r = {0, 0, 0};
+
+	db.setBuddy(buddy);
+	db.init(&pool);
+	srand48(1);
+	double start = benchTime();
+	for(int i = 0; i < OPS; i++)
+	{
+		uint64_t count = (lrand48() % 8) ? (uint64_t) 1 << (16 + lrand48() % 7) : 1 + lrand48() % 4096;
+		while(n > 0 && (n == MAX_LEASES || leased + count > pool_size / 10 * 9))
+		{
+			int k = lrand48() % n;
+			leased -= leases[k]->getSize();
+			db.release(leases[k]);
+			leases[k] = leases[--n];
+		}
+		AssignableSet *set = db.reserve(count, i, 60);
+		if(set == NULL)
+			continue;
+		if(count > 0xffff && set->getSize() < count)
+			r.short_blocks++;
+		leased += set->getSize();
+		leases[n++] = set;
+	}
+	r.ns = (benchTime() - start) * 1e9 / OPS;
+	for(uint64_t addr = POOL_ADDR; addr < POOL_ADDR + pool_size; )
+	{
+		AssignableSet *set = db.search(addr);
+		if(set->m_next_free != NULL)
+			r.free_sets++;
+		addr = set->getLastAddr() + 1;
+	}
+	delete[] leases;
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	printf("pool\tallocator\tns_per_op\tshort_blocks\tfree_sets\n");
+	for(int bits = 30; bits <= 32; bits += 2)
+	{
+		for(int buddy = 0; buddy < 2; buddy++)
+		{
+			Result r = run((uint64_t) 1 << bits, buddy);
+			printf("2^%d\t%s\t%.1f\t%lu\t%lu\n", bits, buddy ? "buddy" : "tree", r.ns, r.short_blocks, r.free_sets);
+		}
+	}
+	return 0;
+}
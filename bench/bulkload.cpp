@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/database.h"
+
+/*
+ * Building a SetDatabase with n leases from a sorted list: init() plus one
+ * restore() per lease, each carving its set through extract(), against
+ * load(), which builds the tree bottom-up and starts every timer at once.
+ * The cost of arming the timers alone is measured apart, one startTimer()
+ * per lease against a single startTimers(). Lists that load() must turn
+ * down are checked first.
+ */
+
+#define POOL_ADDR		0x1ACA00000000
+#define MAX_LEASE		8
+
+static LeaseEntry *makeEntries(int n, uint64_t &pool_size)
+{
+	LeaseEntry *entries = new LeaseEntry[n];
+	uint64_t addr = POOL_ADDR;
+	for(int i = 0; i < n; i++)
+	{
+		addr += lrand48() % MAX_LEASE;
+		entries[i].m_first = addr;
+		entries[i].m_count = 1 + lrand48() % MAX_LEASE;
+		entries[i].m_status = (lrand48() % 4) ? DbStatus::ASSIGNED : DbStatus::RESERVED;
+		entries[i].m_security_id = lrand48();
+		entries[i].m_lifetime = 60 + lrand48() % 3600;
+		addr += entries[i].m_count;
+	}
+	pool_size = addr + MAX_LEASE - POOL_ADDR;
+	return entries;
+}
+
+static void run(int n)
+{
+	uint64_t pool_size;
+	LeaseEntry *entries = makeEntries(n, pool_size);
+	AddrSet pool(POOL_ADDR, pool_size);
+
+	Palma restore_protocol;
+	SetDatabase restored(&restore_protocol);
+	double start = benchTime();
+	restored.init(&pool);
+	for(int i = 0; i < n; i++)
+	{
+		AddrSet set(entries[i].m_first, entries[i].m_count);
+		restored.restore(&set, entries[i].m_security_id, entries[i].m_status == DbStatus::RESERVED,
+							entries[i].m_lifetime);
+	}
+	double restore_ms = (benchTime() - start) * 1e3;
+
+	Palma load_protocol;
+	SetDatabase loaded(&load_protocol);
+	loaded.init(&pool);
+	start = benchTime();
+	if(!loaded.load(&pool, entries, n))
+	{
+		fprintf(stderr, "Load failed\n");
+		exit(1);
+	}
+	double load_ms = (benchTime() - start) * 1e3;
+
+	for(int i = 0; i < n; i++)
+	{
+		AssignableSet *a = restored.search(entries[i].m_first);
+		AssignableSet *b = loaded.search(entries[i].m_first);
+		if(a->getFirstAddr() != b->getFirstAddr() || a->getSize() != b->getSize()
+			|| a->m_reserved != b->m_reserved || b->m_next_free != NULL)
+		{
+			fprintf(stderr, "Databases differ at 0x%lx\n", entries[i].m_first);
+			exit(1);
+		}
+	}
+
+	Timer *timers = new Timer[n];
+	Timer **list = new Timer *[n];
+	for(int i = 0; i < n; i++)
+	{
+		timers[i].set(entries[i].m_lifetime);
+		list[i] = &timers[i];
+	}
+	EventLoop one_by_one;
+	start = benchTime();
+	for(int i = 0; i < n; i++)
+		one_by_one.startTimer(&timers[i]);
+	double single_ms = (benchTime() - start) * 1e3;
+	for(int i = 0; i < n; i++)
+		one_by_one.stopTimer(&timers[i]);
+	for(int i = 0; i < n; i++)
+		timers[i].set(entries[i].m_lifetime);
+	EventLoop at_once;
+	start = benchTime();
+	at_once.startTimers(list, n);
+	double bulk_ms = (benchTime() - start) * 1e3;
+	for(int i = 0; i < n; i++)
+		at_once.stopTimer(&timers[i]);
+
+	printf("%d\t%.1f\t%.1f\t%.1f\t%.2f\t%.2f\t%.1f\n", n, restore_ms, load_ms, restore_ms / load_ms,
+			single_ms, bulk_ms, single_ms / bulk_ms);
+	delete[] list;
+	delete[] timers;
+	delete[] entries;
+}
+
+/* Lists outside the set or overlapping, each of which must be refused
+   with the database left as it was. */
+
+static void checkRejects()
+{
+	AddrSet pool(1000, 100);
+	LeaseEntry bad[][2] = {
+		{{2000, 10, DbStatus::ASSIGNED, 1, 60}, {0, 0, DbStatus::FREE, 0, 0}},
+		{{1095, 10, DbStatus::ASSIGNED, 1, 60}, {0, 0, DbStatus::FREE, 0, 0}},
+		{{900, 10, DbStatus::ASSIGNED, 1, 60}, {0, 0, DbStatus::FREE, 0, 0}},
+		{{1010, 10, DbStatus::ASSIGNED, 1, 60}, {1015, 10, DbStatus::RESERVED, 2, 60}},
+		{{1010, 0, DbStatus::ASSIGNED, 1, 60}, {0, 0, DbStatus::FREE, 0, 0}},
+	};
+	int n[] = {1, 1, 1, 2, 1};
+
+	for(int i = 0; i < 5; i++)
+	{
+		Palma protocol;
+		SetDatabase db(&protocol);
+		db.init(&pool);
+		if(db.load(&pool, bad[i], n[i]) || db.m_root->m_free_count != pool.getSize()
+			|| db.m_root->m_max_free != pool.getSize())
+		{
+			fprintf(stderr, "Invalid list %d accepted\n", i);
+			exit(1);
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	srand48(1);
+	checkRejects();
+	printf("leases\trestore_ms\tload_ms\tspeedup\ttimers_ms\ttimers_bulk_ms\tspeedup\n");
+	run(10000);
+	run(100000);
+	run(1000000);
+	return 0;
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/database.h"
+
+/*
+ * Lease churn on a SetDatabase: a fixed population of leases where every
+ * operation releases a random lease and takes a new one of random size.
+ * Reports the heap allocations per operation (each pool object used to be
+ * a new/delete), and how densely the live tree nodes and sets are packed:
+ * the number of 4 KB pages they touch against the minimum they would need.
+ */
+
+#define POOL_ADDR		0x1ACA00000000
+#define POOL_SIZE		1000000
+#define MAX_LEASE		16
+#define PAGE_SIZE		4096
+
+static uint64_t allocs;
+
+void *operator new(size_t size)
+{
+	allocs++;
+	void *p = malloc(size);
+	if(p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+static int collect(TreeNode *node, uintptr_t *pages, int n)
+{
+	if(node == NULL)
+		return n;
+	pages[n++] = (uintptr_t) node / PAGE_SIZE;
+	for(int i = 0; i < 2; i++)
+		if(node->m_set[i] != NULL)
+			pages[n++] = (uintptr_t) node->m_set[i] / PAGE_SIZE;
+	for(int i = 0; i < 3; i++)
+		n = collect(node->m_child[i], pages, n);
+	return n;
+}
+
+static int cmpPage(const void *a, const void *b)
+{
+	uintptr_t pa = *(uintptr_t *) a, pb = *(uintptr_t *) b;
+	return pa < pb ? -1 : pa > pb;
+}
+
+static void run(int leases, int ops, bool huge)
+{
+	Palma protocol;
+	SetDatabase db(&protocol);
+	AddrSet pool(POOL_ADDR, POOL_SIZE);
+	AssignableSet **live = (AssignableSet **) malloc(leases * sizeof(AssignableSet *));
+
+	db.setHugePages(huge);
+	db.init(&pool);
+	for(int i = 0; i < leases; i++)
+		live[i] = db.findSet(1 + lrand48() % MAX_LEASE);
+
+	allocs = 0;
+	uint64_t pool_allocs = db.m_node_pool.m_allocs + db.m_set_pool.m_allocs;
+	double start = benchTime();
+	for(int i = 0; i < ops; i++)
+	{
+		int idx = lrand48() % leases;
+		db.release(live[idx]);
+		live[idx] = db.findSet(1 + lrand48() % MAX_LEASE);
+		if(live[idx] == NULL)
+		{
+			fprintf(stderr, "Pool exhausted\n");
+			exit(1);
+		}
+	}
+	double elapsed = benchTime() - start;
+	pool_allocs = db.m_node_pool.m_allocs + db.m_set_pool.m_allocs - pool_allocs;
+
+	uint64_t objs = db.m_node_pool.m_in_use + db.m_set_pool.m_in_use;
+	uintptr_t *pages = (uintptr_t *) malloc(objs * sizeof(uintptr_t));
+	int n = collect(db.m_root, pages, 0);
+	qsort(pages, n, sizeof(uintptr_t), cmpPage);
+	int distinct = 0;
+	for(int i = 0; i < n; i++)
+		if(i == 0 || pages[i] != pages[i-1])
+			distinct++;
+	uint64_t bytes = db.m_node_pool.m_in_use * sizeof(TreeNode) + db.m_set_pool.m_in_use * sizeof(AssignableSet);
+
+	printf("%d\t%s\t%.1f\t%.3f\t%.3f\t%d\t%lu\t%lu\n", leases, huge ? "huge" : "4k",
+			elapsed * 1e9 / ops, (double) allocs / ops, (double) pool_allocs / ops,
+			distinct, (bytes + PAGE_SIZE - 1) / PAGE_SIZE,
+			db.m_node_pool.m_hugetlb_slabs + db.m_set_pool.m_hugetlb_slabs);
+	free(pages);
+	free(live);
+}
+
+int main(int argc, char *argv[])
+{
+	int ops = argc > 1 ? atoi(argv[1]) : 1000000;
+
+	srand48(1);
+	printf("leases\tslabs\tns_per_op\tmallocs_per_op\tpool_objs_per_op\tpages\tmin_pages\thugetlb_slabs\n");
+	for(int leases = 1000; leases <= 40000; leases *= 4)
+	{
+		run(leases, ops, false);
+		run(leases, ops, true);
+	}
+	return 0;
+}
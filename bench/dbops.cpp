@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/database.h"
+#include "../common/simulator.h"
+
+/*
+ * Cost of every SetDatabase operation, one at a time, on pools of 10^3 to
+ * 10^7 addresses. The pool is first filled with leases of 1 to 16
+ * addresses and then leases are released at random until only the given
+ * fraction of the addresses stays leased, which leaves as many scattered
+ * holes as leases. Every operation is timed on its own and undone,
+ * untimed, so that all the samples see the same database. Expiry is
+ * driven by the timers of a Simulator, one lease per step, for as many
+ * leases as the free addresses hold. For each pool, fraction and
+ * operation reports the time per operation and its percentiles, the heap
+ * allocations and pool slabs per operation and the resident memory, as
+ * JSON lines to compare runs across commits.
+ *
+ *		bench-dbops [-p <pool sizes>] [-u <leased fractions>] [-n <ops>] [-o <output filename>]
+ *
+ * Lists are comma separated, by default 1000,...,10000000 and 0,0.5,0.9.
+ */
+
+#define POOL_ADDR		0x1ACA00000000
+#define MAX_LEASE		16
+#define LIFETIME		60000
+#define EXPIRY_SPACING	1e-6
+#define MAX_LIST		16
+
+/* Every heap allocation of the process is counted on its way to glibc. */
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t allocs;
+
+extern "C" void *malloc(size_t size)
+{
+	allocs++;
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+	allocs++;
+	return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+	allocs++;
+	return __libc_realloc(ptr, size);
+}
+
+enum Op
+{
+	OP_RESERVE,
+	OP_ASSIGN_COUNT,
+	OP_ASSIGN_SET,
+	OP_RELEASE,
+	OP_EXCLUDE,
+	OP_CHECK_STATUS,
+	OP_SEARCH,
+	OP_EXPIRE,
+	NUM_OPS
+};
+
+static const char *op_names[NUM_OPS] = {"reserve", "assign_count", "assign_set", "release",
+										"exclude", "check_status", "search", "expire"};
+
+struct Sample
+{
+	double *m_ns;
+	int m_n;
+	uint64_t m_allocs;
+	uint64_t m_slabs;
+};
+
+static FILE *out;
+static double clock_ns;
+static uint64_t next_id;
+
+static uint64_t rssKb()
+{
+	long pages = 0, resident = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+	if(f == NULL)
+		return 0;
+	if(fscanf(f, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(f);
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static uint64_t peakRssKb()
+{
+	char line[128];
+	uint64_t kb = 0;
+	FILE *f = fopen("/proc/self/status", "r");
+	if(f == NULL)
+		return 0;
+	while(fgets(line, sizeof(line), f) != NULL)
+	{
+		if(strncmp(line, "VmHWM:", 6) == 0)
+			kb = strtoull(line + 6, NULL, 10);
+	}
+	fclose(f);
+	return kb;
+}
+
+static uint64_t slabs(SetDatabase *db)
+{
+	return db->m_node_pool.m_slabs + db->m_set_pool.m_slabs;
+}
+
+static uint64_t leaseSize()
+{
+	return 1 + lrand48() % MAX_LEASE;
+}
+
+/* Leases the whole pool and gives back leases in random order until no
+   more than the given fraction stays leased. Returns the leases left. */
+
+static AssignableSet **fragment(SetDatabase *db, uint64_t pool, double used, uint64_t &nleases)
+{
+	uint64_t size = pool / MAX_LEASE + 1;
+	AssignableSet **leases = NULL;
+	nleases = 0;
+	if(used <= 0)
+		return leases;
+	while(db->m_root->m_max_free > 0)
+	{
+		if(nleases == 0 || nleases == size)
+		{
+			size = nleases ? 2 * size : size;
+			leases = (AssignableSet **) realloc(leases, size * sizeof(AssignableSet *));
+			if(leases == NULL)
+			{
+				perror("Growing lease list");
+				exit(1);
+			}
+		}
+		leases[nleases++] = db->reserve(leaseSize(), next_id++, LIFETIME);
+	}
+	uint64_t leased = pool;
+	while(leased > used * pool && nleases > 0)
+	{
+		uint64_t i = lrand48() % nleases;
+		leased -= leases[i]->getSize();
+		db->release(leases[i]);
+		leases[i] = leases[--nleases];
+	}
+	return leases;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+static void report(uint64_t pool, double used, SetDatabase *db, Op op, Sample *s)
+{
+	double sum = 0;
+	if(s->m_n == 0)
+		return;
+	for(int i = 0; i < s->m_n; i++)
+		sum += s->m_ns[i];
+	qsort(s->m_ns, s->m_n, sizeof(double), compareDouble);
+	uint64_t free_count = db->m_root->m_free_count;
+	fprintf(out, "{\"pool\": %lu, \"used\": %.2f, \"op\": \"%s\", \"ops\": %d, "
+			"\"ns_mean\": %.1f, \"ns_p50\": %.1f, \"ns_p90\": %.1f, \"ns_p99\": %.1f, \"ns_p999\": %.1f, \"ns_max\": %.1f, "
+			"\"allocs_per_op\": %.4f, \"slabs\": %lu, \"sets\": %lu, \"frag\": %.4f, \"rss_kb\": %lu, \"peak_rss_kb\": %lu}\n",
+			pool, used, op_names[op], s->m_n, sum / s->m_n, s->m_ns[s->m_n / 2], s->m_ns[s->m_n * 9 / 10],
+			s->m_ns[s->m_n * 99 / 100], s->m_ns[s->m_n * 999 / 1000], s->m_ns[s->m_n - 1],
+			(double) s->m_allocs / s->m_n, s->m_slabs, db->m_set_pool.m_in_use,
+			free_count ? 1 - (double) db->m_root->m_max_free / free_count : 0., rssKb(), peakRssKb());
+	fflush(out);
+}
+
+/* A random run of free addresses, inside one free set. */
+
+static void freeRun(SetDatabase *db, AddrSet &set)
+{
+	uint64_t offset = (lrand48() ^ ((uint64_t) lrand48() << 31)) % db->m_root->m_free_count;
+	AssignableSet *free_set = db->m_root->findFreeAt(offset);
+	uint64_t count = leaseSize();
+	if(count > free_set->getSize())
+		count = free_set->getSize();
+	uint64_t first = free_set->getFirstAddr() + lrand48() % (free_set->getSize() - count + 1);
+	set = AddrSet(first, count);
+}
+
+static void measure(Simulator *sim, SetDatabase *db, uint64_t pool, AssignableSet **leases, uint64_t nleases, Op op, Sample *s)
+{
+	uint64_t security_id, slabs_start = slabs(db), in_use = db->m_set_pool.m_in_use;
+	uint16_t lifetime;
+	bool identical;
+	AssignableSet *result, *set;
+	AddrSet addrs;
+	double start, stop;
+	int n = s->m_n;
+
+	s->m_allocs = 0;
+	if(op == OP_EXPIRE)
+	{
+		/* As many leases as fit, each expiring on its own step. */
+		for(n = 0; n < s->m_n && db->reserve(leaseSize(), next_id++, 1) != NULL; n++)
+			sim->run(EXPIRY_SPACING);
+		sim->run(1 - n * EXPIRY_SPACING - EXPIRY_SPACING);
+		s->m_n = n;
+	}
+	for(int i = 0; i < n; i++)
+	{
+		uint64_t count = leaseSize();
+		uint64_t allocs_start;
+		switch(op)
+		{
+			case OP_RESERVE:
+				allocs_start = allocs;
+				start = benchTime();
+				set = db->reserve(count, next_id++, LIFETIME);
+				stop = benchTime();
+				s->m_allocs += allocs - allocs_start;
+				db->release(set);
+				break;
+			case OP_ASSIGN_COUNT:
+				allocs_start = allocs;
+				start = benchTime();
+				set = (AssignableSet *) db->assign(count, next_id++, LIFETIME);
+				stop = benchTime();
+				s->m_allocs += allocs - allocs_start;
+				db->release(set);
+				break;
+			case OP_ASSIGN_SET:
+				set = db->reserve(count, next_id, LIFETIME);
+				addrs = *set;
+				allocs_start = allocs;
+				start = benchTime();
+				set = (AssignableSet *) db->assign(set, &addrs, next_id++, LIFETIME);
+				stop = benchTime();
+				s->m_allocs += allocs - allocs_start;
+				db->release(set);
+				break;
+			case OP_RELEASE:
+				set = db->reserve(count, next_id++, LIFETIME);
+				allocs_start = allocs;
+				start = benchTime();
+				db->release(set);
+				stop = benchTime();
+				s->m_allocs += allocs - allocs_start;
+				break;
+			case OP_EXCLUDE:
+				freeRun(db, addrs);
+				allocs_start = allocs;
+				start = benchTime();
+				db->exclude(&addrs, LIFETIME);
+				stop = benchTime();
+				s->m_allocs += allocs - allocs_start;
+				db->release(db->search(addrs.getFirstAddr()));
+				break;
+			case OP_CHECK_STATUS:
+				if(nleases > 0)
+					addrs = *leases[lrand48() % nleases];
+				else
+					addrs = AddrSet(POOL_ADDR + lrand48() % (pool - count + 1), count);
+				allocs_start = allocs;
+				start = benchTime();
+				db->checkStatus(&addrs, security_id, lifetime, identical, result);
+				stop = benchTime();
+				s->m_allocs += allocs - allocs_start;
+				break;
+			case OP_SEARCH:
+				count = POOL_ADDR + lrand48() % pool;
+				allocs_start = allocs;
+				start = benchTime();
+				db->search(count);
+				stop = benchTime();
+				s->m_allocs += allocs - allocs_start;
+				break;
+			case OP_EXPIRE:
+				allocs_start = allocs;
+				start = benchTime();
+				sim->step();
+				stop = benchTime();
+				s->m_allocs += allocs - allocs_start;
+				break;
+			default:
+				abort();
+		}
+		s->m_ns[i] = (stop - start) * 1e9 - clock_ns;
+	}
+	if(db->m_set_pool.m_in_use != in_use)
+		fprintf(stderr, "%s did not leave the database as it was\n", op_names[op]);
+	s->m_slabs = slabs(db) - slabs_start;
+}
+
+static void run(uint64_t pool, double used, int nops)
+{
+	Simulator sim(1);
+	Palma protocol;
+	SetDatabase db(&protocol);
+	AddrSet total(POOL_ADDR, pool);
+	uint64_t nleases;
+	Sample s;
+
+	sim.attach(&protocol.m_event_loop);
+	db.init(&total);
+	AssignableSet **leases = fragment(&db, pool, used, nleases);
+	s.m_ns = new double[nops];
+	for(int op = 0; op < NUM_OPS; op++)
+	{
+		s.m_n = nops;
+		measure(&sim, &db, pool, leases, nleases, (Op) op, &s);
+		report(pool, used, &db, (Op) op, &s);
+	}
+	delete[] s.m_ns;
+	free(leases);
+}
+
+static int parseList(char *arg, double *values)
+{
+	int n = 0;
+	for(char *tok = strtok(arg, ","); tok != NULL && n < MAX_LIST; tok = strtok(NULL, ","))
+		values[n++] = atof(tok);
+	return n;
+}
+
+#define USAGE	"Uso:%s [-p <pool sizes>][-u <leased fractions>][-n <ops>][-o <output filename>]\n"
+
+int main(int argc, char *argv[])
+{
+	double pools[MAX_LIST] = {1e3, 1e4, 1e5, 1e6, 1e7};
+	double used[MAX_LIST] = {0, 0.5, 0.9};
+	int npools = 5, nused = 3, nops = 100000, c;
+	char *outname = NULL;
+
+	while ((c = getopt (argc, argv, "p:u:n:o:")) != -1)
+	{
+		switch (c)
+		{
+			case 'p':
+				npools = parseList(optarg, pools);
+				break;
+			case 'u':
+				nused = parseList(optarg, used);
+				break;
+			case 'n':
+				nops = atoi(optarg);
+				break;
+			case 'o':
+				outname = optarg;
+				break;
+			default:
+				fprintf(stderr,	USAGE, argv[0]);
+				exit(1);
+		}
+	}
+	for(int i = 0; i < nused; i++)
+	{
+		if(used[i] < 0 || used[i] >= 1)
+		{
+			fprintf(stderr, "Leased fractions must be in [0, 1).\n");
+			exit(1);
+		}
+	}
+	if(nops < 1 || nops * EXPIRY_SPACING >= 0.5)
+	{
+		fprintf(stderr, "Invalid number of operations.\n");
+		exit(1);
+	}
+	out = stdout;
+	if(outname != NULL && (out = fopen(outname, "w")) == NULL)
+	{
+		perror("Opening output file");
+		exit(1);
+	}
+
+	double start = benchTime();
+	for(int i = 0; i < 1000000; i++)
+		benchTime();
+	clock_ns = (benchTime() - start) * 1e3;
+	fprintf(out, "{\"bench\": \"dbops\", \"clock_ns\": %.1f, \"max_lease\": %d}\n", clock_ns, MAX_LEASE);
+	for(int p = 0; p < npools; p++)
+	{
+		for(int u = 0; u < nused; u++)
+			run((uint64_t) pools[p], used[u], nops);
+	}
+	if(out != stdout)
+		fclose(out);
+	return 0;
+}
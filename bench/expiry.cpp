@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/database.h"
+
+/*
+ * Expiry of a burst of leases granted at the same moment. The pool is
+ * first fragmented with leases of 1 to 16 addresses, one in three of them
+ * released, and then the burst is taken, partly filling the holes and
+ * partly in one stretch after them. The burst expires through one
+ * timeout() per lease, as before, and through SetDatabase::expire(), on
+ * two databases built the same way. Reports the time per lease and the
+ * latency of the whole burst. A group expiry that outlasts the next
+ * timer is checked first.
+ */
+
+#define POOL_ADDR		0x1ACA00000000
+#define POOL_SIZE		((uint64_t) 1 << 22)
+#define BACKGROUND		200000
+
+static AssignableSet **build(SetDatabase *db, int burst)
+{
+	AddrSet pool(POOL_ADDR, POOL_SIZE);
+	AssignableSet **leases = new AssignableSet *[BACKGROUND];
+	AssignableSet **sets = new AssignableSet *[burst];
+
+	db->init(&pool);
+	srand48(1);
+	for(int i = 0; i < BACKGROUND; i++)
+		leases[i] = db->reserve(1 + lrand48() % 16, i, 60);
+	for(int i = 0; i < BACKGROUND; i += 3)
+		db->release(leases[i]);
+	for(int i = 0; i < burst; i++)
+		sets[i] = db->reserve(1 + lrand48() % 8, BACKGROUND + i, 60);
+	for(int i = 0; i < burst; i++)
+		db->m_protocol->m_event_loop.stopTimer(sets[i]);
+	delete[] leases;
+	return sets;
+}
+
+/* Takes time of a virtual clock to expire its timers. */
+
+class SlowGroup : public TimerGroup, public Timer
+{
+public:
+	VirtualClock *m_clock;
+	int m_expired;
+
+	SlowGroup(VirtualClock *clock) : m_clock(clock), m_expired(0) {}
+	TimerGroup *group() {return this;}
+	void expire(Timer **timers, int n) {m_expired += n; m_clock->advance(0.01);}
+};
+
+class CountTimer : public Timer
+{
+public:
+	int m_fired;
+
+	CountTimer() : m_fired(0) {}
+	void timeout() {m_fired++;}
+};
+
+/* A timer that falls due while a group expires must fire in the same
+   check, and the wait returned for the next one must not be negative. */
+
+static bool checkSlowGroup()
+{
+	VirtualClock clock;
+	Clock::install(&clock);
+	TimerList timers;
+	SlowGroup slow(&clock);
+	CountTimer next, later;
+	Time t;
+
+	slow.set(0.001);
+	next.set(0.005);
+	later.set(1.);
+	timers.add(&slow);
+	timers.add(&next);
+	timers.add(&later);
+	clock.advance(0.002);
+	Time *wait = timers.check(&t);
+	bool ok = slow.m_expired == 1 && next.m_fired == 1 && later.m_fired == 0
+				&& wait != NULL && wait->tv_sec >= 0 && wait->tv_nsec >= 0;
+	timers.del(&later);
+	Clock::install(NULL);
+	printf("slow group expiry: %s\n", ok ? "ok" : "FAIL");
+	return ok;
+}
+
+static void run(int burst)
+{
+	Palma protocol;
+	SetDatabase single(&protocol), batch(&protocol);
+	AssignableSet **sets = build(&single, burst);
+
+	double start = benchTime();
+	for(int i = 0; i < burst; i++)
+		sets[i]->timeout();
+	double t_single = benchTime() - start;
+	delete[] sets;
+
+	sets = build(&batch, burst);
+	Timer **timers = new Timer *[burst];
+	for(int i = 0; i < burst; i++)
+		timers[i] = sets[i];
+	start = benchTime();
+	batch.expire(timers, burst);
+	double t_batch = benchTime() - start;
+	delete[] timers;
+	delete[] sets;
+
+	printf("%d\t%lu\t%s\t%.1f\t%.1f\t%.3f\t%.3f\t%.2f\n", burst, single.m_set_pool.m_in_use,
+			batch.m_expire_rebuilds ? "rebuild" : "runs", t_single * 1e9 / burst, t_batch * 1e9 / burst,
+			t_single * 1e3, t_batch * 1e3, t_single / t_batch);
+	if(single.m_set_pool.m_in_use != batch.m_set_pool.m_in_use
+		|| single.m_root->m_free_count != batch.m_root->m_free_count)
+		printf("MISMATCH\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if(!checkSlowGroup())
+		return 1;
+	printf("burst\tsets\tpath\tns_single\tns_batch\tms_single\tms_batch\tspeedup\n");
+	run(1000);
+	run(10000);
+	run(50000);
+	run(100000);
+	run(200000);
+	return 0;
+}
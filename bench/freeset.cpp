@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/database.h"
+
+/* Unicast pool and default offer size from configs/server.xml */
+
+#define POOL_ADDR		0x1ACA00000000
+#define POOL_SIZE		100000
+#define OFFER_SIZE		100
+#define ROUNDS			20000
+
+/*
+ * Fragments the pool with single address leases, releasing every other
+ * one so that each release leaves an isolated free block, and then times
+ * the reservation of an offer set as done on every DISCOVER.
+ */
+static double discoverCost(int free_blocks)
+{
+	Palma protocol;
+	SetDatabase db(&protocol);
+	AddrSet pool(POOL_ADDR, POOL_SIZE);
+	AssignableSet **leases = new AssignableSet *[2*free_blocks];
+
+	db.init(&pool);
+	for(int i=0; i<2*free_blocks; i++)
+		leases[i] = db.findSet(1);
+	for(int i=0; i<2*free_blocks; i+=2)
+		db.release(leases[i]);
+
+	double start = benchTime();
+	for(int i=0; i<ROUNDS; i++)
+	{
+		AssignableSet *set = db.findSet(OFFER_SIZE);
+		if(set == NULL)
+		{
+			fprintf(stderr, "Pool exhausted\n");
+			exit(1);
+		}
+		db.release(set);
+	}
+	double elapsed = benchTime() - start;
+	delete[] leases;
+	return elapsed / ROUNDS * 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	int max_blocks = argc > 1 ? atoi(argv[1]) : 40000;
+
+	Palma::initRandom();
+	printf("free_blocks\tns_per_discover\n");
+	for(int blocks = 0; blocks <= max_blocks; blocks += max_blocks / 8)
+	{
+		printf("%d\t%.1f\n", blocks + 1, discoverCost(blocks));
+		if(max_blocks < 8)
+			break;
+	}
+	return 0;
+}
@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "bench.h"
+#include "../server/palma-server.h"
+#include "../common/details.h"
+
+/*
+ * Capacity of a server, as test/test-perfo.py and test/process.py measure
+ * it from the logs of many clients, without the clients. A driver stands
+ * for the link of the server: it hands over DISCOVERs arriving as a
+ * Poisson process of the given rate, or back to back with rate 0, and
+ * answers every OFFER with a REQUEST at once. The server runs its timers
+ * on the real clock and answers while it handles the frame, so the time
+ * to the OFFER is counted from when the DISCOVER was due, including the
+ * wait behind earlier ones when the server falls behind, and the time to
+ * the ACK from when the REQUEST was handed over. Leases are long enough
+ * not to expire during the run, so that the live leases keep growing.
+ * Every window of handshakes reports the live leases at its end, the
+ * handshakes per second achieved and the percentiles of both latencies.
+ *
+ *		bench-handshake [-c <config filename>][-r <rate>][-n <handshakes>][-w <window>][-p <pool size>][-s <lease size>]
+ */
+
+#define SERVER_CONFIG	"../configs/server.xml"
+#define POOL_ADDR		0x1ACA00000000
+#define LIFETIME		0xffff
+
+/* The link of the server. It answers while the frame is being handled,
+   so only the last frame sent is kept, with the time it was sent. */
+
+class Driver : public Transport
+{
+public:
+	uint8_t m_reply[MAX_PKT_SIZE];
+	int m_reply_len;
+	double m_reply_time;
+
+	Driver() : m_reply_len(0), m_reply_time(0) {}
+	void join(NetItf *itf, uint64_t addr) {}
+	void leave(NetItf *itf, uint64_t addr) {}
+
+	void send(NetItf *itf, uint8_t *data, int len)
+	{
+		m_reply_time = benchTime();
+		memcpy(m_reply, data, len);
+		m_reply_len = len;
+	}
+};
+
+struct Window
+{
+	double *m_offer_us;
+	double *m_ack_us;
+	int m_n;
+	uint64_t m_failed;
+	double m_start;
+};
+
+static int compareDouble(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+static void report(Window *w, uint64_t leases, double rate)
+{
+	double now = benchTime();
+	int n = w->m_n;
+	if(n > 0)
+	{
+		qsort(w->m_offer_us, n, sizeof(double), compareDouble);
+		qsort(w->m_ack_us, n, sizeof(double), compareDouble);
+		printf("%lu\t%d\t%lu\t%.0f\t%.0f\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\n", leases, n, w->m_failed,
+				rate, n / (now - w->m_start),
+				w->m_offer_us[n / 2], w->m_offer_us[n * 99 / 100], w->m_offer_us[n * 999 / 1000], w->m_offer_us[n - 1],
+				w->m_ack_us[n / 2], w->m_ack_us[n * 99 / 100], w->m_ack_us[n * 999 / 1000], w->m_ack_us[n - 1]);
+		fflush(stdout);
+	}
+	w->m_n = 0;
+	w->m_failed = 0;
+	w->m_start = now;
+}
+
+static PacketView *deliver(PalmaServer *server, Driver *driver, Packet *pkt, PacketView *view)
+{
+	uint8_t frame[MAX_PKT_SIZE];
+	int len = pkt->toBuffer(frame);
+	driver->m_reply_len = 0;
+	server->m_netitf.receive(frame, len);
+	if(driver->m_reply_len == 0 || view->parse(driver->m_reply, driver->m_reply_len) != 0)
+		return NULL;
+	return view;
+}
+
+#define USAGE	"Uso:%s [-c <config filename>][-r <rate>][-n <handshakes>][-w <window>][-p <pool size>][-s <lease size>]\n"
+
+int main(int argc, char *argv[])
+{
+	const char *confname = SERVER_CONFIG;
+	double rate = 0;
+	long nhandshakes = 1000000, window = 100000;
+	uint64_t pool = 1 << 24, lease = 1;
+	int c;
+
+	while ((c = getopt (argc, argv, "c:r:n:w:p:s:")) != -1)
+	{
+		switch (c)
+		{
+			case 'c':
+				confname = optarg;
+				break;
+			case 'r':
+				rate = atof(optarg);
+				break;
+			case 'n':
+				nhandshakes = atol(optarg);
+				break;
+			case 'w':
+				window = atol(optarg);
+				break;
+			case 'p':
+				pool = strtoull(optarg, NULL, 0);
+				break;
+			case 's':
+				lease = strtoull(optarg, NULL, 0);
+				break;
+			default:
+				fprintf(stderr,	USAGE, argv[0]);
+				exit(1);
+		}
+	}
+	if(rate < 0 || nhandshakes < 1 || window < 1 || pool < 1 || lease < 1 || lease > 0xffff)
+	{
+		fprintf(stderr,"Invalid arguments.\n");
+		fprintf(stderr,	USAGE, argv[0]);
+		exit(1);
+	}
+
+	PalmaServer *server = new PalmaServer();
+	Driver driver;
+	TimerList timers;
+	AddrSet unicast_set(POOL_ADDR, pool);
+	uint16_t lifetime = LIFETIME;
+
+	server->m_config.set(ConfigItem::INTERFACE, (void *) "driver");
+	if(!server->m_config.read(confname))
+	{
+		fprintf(stderr, "Invalid configuration in: %s\n", confname);
+		exit(1);
+	}
+	server->m_config.set(ConfigItem::UNICAST_SET, &unicast_set);
+	server->m_config.set(ConfigItem::MAX_ADDR_UNICAST, &lease);
+	server->m_config.set(ConfigItem::UNICAST_LIFETIME, &lifetime);
+	server->m_event_loop.setTimerList(&timers);
+	server->begin(&driver);
+	uint64_t server_addr = TO_ADDR(server->m_config.get(ConfigItem::SRC_ADDR));
+
+	Window w;
+	w.m_offer_us = new double[window];
+	w.m_ack_us = new double[window];
+	w.m_n = 0;
+	w.m_failed = 0;
+	PacketView view;
+	Time t;
+	char station[32];
+	uint64_t leases = 0, failed = 0;
+	AddrSet claim(POOL_ADDR, lease);
+	AddrSet source(DISCOVER_SOURCE_ADDR_RANGE);
+
+	printf("leases\thandshakes\tfailed\trate\thandshakes_s\toffer_p50_us\toffer_p99_us\toffer_p999_us\toffer_max_us"
+			"\tack_p50_us\tack_p99_us\tack_p999_us\tack_max_us\n");
+	srand48(1);
+	double start = benchTime(), due = start;
+	w.m_start = start;
+	for(long i = 0; i < nhandshakes; i++)
+	{
+		uint16_t token = i & 0xffff;
+		snprintf(station, sizeof(station), "host%ld", i);
+		Packet discover(MsgType::DISCOVER, PALMA_MCAST, source.getFirstAddr() + i, token);
+		discover.addMacSetPar(&claim);
+		discover.addIdPar(ParType::STATION_ID, (uint8_t *) station);
+		if(rate > 0)
+		{
+			due += -log(1 - drand48()) / rate;
+			while(benchTime() < due)
+				timers.check(&t);
+		}
+		else
+			due = benchTime();
+		timers.check(&t);
+
+		PacketView *offer = deliver(server, &driver, &discover, &view);
+		PacketView *ack = NULL;
+		double offer_us = 0, sent = 0;
+		if(offer != NULL && offer->getType() == MsgType::OFFER && offer->getToken() == token)
+		{
+			offer_us = (driver.m_reply_time - due) * 1e6;
+			AddrSet offered(*offer->getSet());
+			uint64_t src_addr = offer->getClientAddr() ? offer->getClientAddr() : offered.getFirstAddr();
+			Packet request(MsgType::REQUEST, server_addr, src_addr, token);
+			request.addMacSetPar(&offered);
+			request.addIdPar(ParType::STATION_ID, (uint8_t *) station);
+			sent = benchTime();
+			ack = deliver(server, &driver, &request, &view);
+		}
+		if(ack != NULL && ack->getType() == MsgType::ACK && ack->getStatus() == StatusCode::ASSIGN_OK)
+		{
+			w.m_offer_us[w.m_n] = offer_us;
+			w.m_ack_us[w.m_n++] = (driver.m_reply_time - sent) * 1e6;
+			leases++;
+		}
+		else
+		{
+			w.m_failed++;
+			failed++;
+		}
+		if(w.m_n + w.m_failed == (uint64_t) window)
+			report(&w, leases, rate);
+	}
+	report(&w, leases, rate);
+	double wall = benchTime() - start;
+	fprintf(stderr, "%ld handshakes, %lu failed, %lu live leases, %.2f s, %.0f handshakes/s\n",
+			nhandshakes, failed, leases, wall, leases / wall);
+	delete[] w.m_offer_us;
+	delete[] w.m_ack_us;
+	delete server;
+	return 0;
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/database.h"
+#include "../server/lease-journal.h"
+
+/*
+ * Cost of the lease journal for the event loop and for a restart. A set of
+ * leases is taken and renewed on the unicast pool of configs/server.xml,
+ * with and without the journal attached, to get the time each operation
+ * spends queueing its record and how many records every fdatasync
+ * commits. The CPU time of the calling thread is reported apart from the
+ * elapsed time, which on a single core also pays for the writer thread.
+ * The databases are then rebuilt from the files, as at startup. Before
+ * that, leases changed by exclude() and by assigning over a reservation
+ * are replayed from a copy of the files taken before the journal is
+ * closed, as a crash would leave them, and checked against the database.
+ */
+
+#define POOL_ADDR		0x1ACA00000000
+#define POOL_SIZE		100000
+#define LEASES			50000
+#define ROUNDS			4
+
+static double threadTime()
+{
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double churn(SetDatabase *db, AssignableSet **leases, double &cpu)
+{
+	double start = benchTime();
+	double cpu_start = threadTime();
+	for(int i = 0; i < LEASES; i++)
+		leases[i] = db->reserve(1, i, 3);
+	for(int r = 0; r < ROUNDS; r++)
+		for(int i = 0; i < LEASES; i++)
+		{
+			AddrSet set = *leases[i];
+			leases[i] = (AssignableSet *) db->assign(leases[i], &set, i, 3600);
+		}
+	cpu = (threadTime() - cpu_start) * 1e9 / (LEASES * (ROUNDS + 1));
+	return (benchTime() - start) * 1e9 / (LEASES * (ROUNDS + 1));
+}
+
+static void copyFile(const char *from, const char *to)
+{
+	char buf[4096];
+	size_t len;
+	FILE *in = fopen(from, "rb");
+	FILE *out = fopen(to, "wb");
+	if(in == NULL || out == NULL)
+	{
+		perror("Copying journal");
+		exit(1);
+	}
+	while((len = fread(buf, 1, sizeof(buf), in)) > 0)
+		fwrite(buf, 1, len, out);
+	fclose(in);
+	fclose(out);
+}
+
+static AssignableSet *lease(SetDatabase *db, uint64_t first, uint64_t count, uint64_t security_id)
+{
+	AddrSet set(first, count);
+	return (AssignableSet *) db->assign(db->search(first), &set, security_id, 600);
+}
+
+static void checkExclude(const char *path)
+{
+	char crash_path[256], snap_path[256], crash_snap_path[256];
+	AddrSet pool(POOL_ADDR, 256);
+	SipHash hash;
+
+	snprintf(crash_path, sizeof(crash_path), "%s.crash", path);
+	snprintf(snap_path, sizeof(snap_path), "%s.snap", path);
+	snprintf(crash_snap_path, sizeof(crash_snap_path), "%s.snap", crash_path);
+	unlink(path);
+	unlink(snap_path);
+	unlink(crash_path);
+	unlink(crash_snap_path);
+
+	Palma protocol;
+	SetDatabase db(&protocol);
+	SetDatabase *dbs[] = {&db};
+	LeaseJournal *journal = new LeaseJournal();
+	db.init(&pool);
+	journal->open(path, dbs, 1, &hash, &protocol.m_event_loop, 0);
+	lease(&db, POOL_ADDR, 4, 1);
+	lease(&db, POOL_ADDR + 4, 4, 2);
+	lease(&db, POOL_ADDR + 12, 4, 4);
+	AssignableSet *reserved = db.reserve(4, 3, 30);
+	AddrSet part(reserved->getFirstAddr(), 2);
+	db.assign(reserved, &part, 3, 600);
+	AddrSet renewed(POOL_ADDR, 4), joined(POOL_ADDR + 6, 8), split(part.getFirstAddr() + 1, 3);
+	db.exclude(&renewed, 100);
+	db.exclude(&joined, 300);
+	db.exclude(&split, 200);
+
+	/* Waits for the writer to commit every record. */
+	struct stat st;
+	double start = benchTime();
+	while(stat(path, &st) != 0 || (uint64_t) st.st_size < journal->m_records * sizeof(JournalRecord))
+	{
+		if(benchTime() - start > 10)
+		{
+			fprintf(stderr, "Journal records not written\n");
+			exit(1);
+		}
+		usleep(1000);
+	}
+	copyFile(path, crash_path);
+	copyFile(snap_path, crash_snap_path);
+
+	Palma restart_protocol;
+	SetDatabase restarted(&restart_protocol);
+	SetDatabase *restart_dbs[] = {&restarted};
+	LeaseJournal *replay = new LeaseJournal();
+	restarted.init(&pool);
+	replay->open(crash_path, restart_dbs, 1, &hash, &restart_protocol.m_event_loop, 0);
+	for(uint64_t addr = pool.getFirstAddr(); addr <= pool.getLastAddr(); addr++)
+	{
+		/* Free space may be split differently, the leases may not. */
+		AssignableSet *a = db.search(addr), *b = restarted.search(addr);
+		bool leased = a->m_next_free == NULL;
+		if(leased != (b->m_next_free == NULL)
+			|| (leased && (a->getFirstAddr() != b->getFirstAddr() || a->getSize() != b->getSize()
+				|| fabs(protocol.m_event_loop.readTimer(a) - restart_protocol.m_event_loop.readTimer(b)) > 2.)))
+		{
+			fprintf(stderr, "Replayed journal differs at %lx\n", addr);
+			exit(1);
+		}
+	}
+	replay->close();
+	journal->close();
+	delete replay;
+	delete journal;
+	unlink(path);
+	unlink(snap_path);
+	unlink(crash_path);
+	unlink(crash_snap_path);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = argc > 1 ? argv[1] : "/tmp/palma-bench.journal";
+	AddrSet pool(POOL_ADDR, POOL_SIZE);
+	AssignableSet **leases = new AssignableSet *[LEASES];
+	SipHash hash;
+	char snap_path[256];
+
+	checkExclude(path);
+	snprintf(snap_path, sizeof(snap_path), "%s.snap", path);
+	unlink(path);
+	unlink(snap_path);
+
+	Palma plain_protocol;
+	SetDatabase plain(&plain_protocol);
+	plain.init(&pool);
+	double base_cpu, logged_cpu;
+	double base = churn(&plain, leases, base_cpu);
+
+	Palma protocol;
+	SetDatabase db(&protocol);
+	SetDatabase *dbs[] = {&db};
+	LeaseJournal *journal = new LeaseJournal();
+	db.init(&pool);
+	journal->open(path, dbs, 1, &hash, &protocol.m_event_loop, 0);
+	double logged = churn(&db, leases, logged_cpu);
+	journal->close();
+	printf("ns_per_op\tns_per_op_journal\tcpu_ns_per_op\tcpu_ns_per_op_journal\trecords\tcommits\trecords_per_commit\tstalls\n");
+	printf("%.1f\t%.1f\t%.1f\t%.1f\t%lu\t%lu\t%.1f\t%lu\n", base, logged, base_cpu, logged_cpu,
+			journal->m_records, journal->m_commits,
+			(double) journal->m_records / journal->m_commits, journal->m_stalls);
+	delete journal;
+
+	Palma restart_protocol;
+	SetDatabase restarted(&restart_protocol);
+	SetDatabase *restart_dbs[] = {&restarted};
+	journal = new LeaseJournal();
+	restarted.init(&pool);
+	double start = benchTime();
+	journal->open(path, restart_dbs, 1, &hash, &restart_protocol.m_event_loop, 0);
+	double startup = benchTime() - start;
+	printf("leases\trestore_ms\tstartup_ms\n");
+	printf("%lu\t%.1f\t%.1f\n", journal->m_restored, journal->m_restore_time * 1e3, startup * 1e3);
+	journal->close();
+	delete journal;
+	delete[] leases;
+	return 0;
+}
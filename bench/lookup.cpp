@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/database.h"
+
+/*
+ * Address lookup cost in a SetDatabase holding n intervals, walking the
+ * 2-3 tree against the B+tree index. The pool is split into n single
+ * address leases (every other one released, so both free and leased sets
+ * are present) and the same random addresses are searched in both.
+ */
+
+#define POOL_ADDR		0x1ACA00000000
+#define LOOKUPS			2000000
+
+static double lookupCost(SetDatabase *db, uint64_t *addrs, bool btree, uint64_t &check)
+{
+	int index;
+	double start = benchTime();
+	for(int i = 0; i < LOOKUPS; i++)
+	{
+		AssignableSet *set;
+		if(btree)
+			set = db->m_btree.search(addrs[i]);
+		else
+			set = db->m_root->locate(addrs[i], index)->getSet(index);
+		check += set->getFirstAddr();
+	}
+	return (benchTime() - start) * 1e9 / LOOKUPS;
+}
+
+static void run(int intervals)
+{
+	Palma protocol;
+	SetDatabase db(&protocol);
+	AddrSet pool(POOL_ADDR, intervals + 1);
+	AssignableSet **leases = new AssignableSet *[intervals];
+	uint64_t *addrs = new uint64_t[LOOKUPS];
+	uint64_t check_tree = 0, check_btree = 0;
+
+	db.setBTreeIndex(true);
+	db.init(&pool);
+	for(int i = 0; i < intervals; i++)
+		leases[i] = db.findSet(1);
+	for(int i = 1; i < intervals; i += 4)
+		db.release(leases[i]);
+	for(int i = 0; i < LOOKUPS; i++)
+		addrs[i] = POOL_ADDR + lrand48() % intervals;
+
+	double tree = lookupCost(&db, addrs, false, check_tree);
+	double btree = lookupCost(&db, addrs, true, check_btree);
+	if(check_tree != check_btree)
+	{
+		fprintf(stderr, "Indexes disagree\n");
+		exit(1);
+	}
+	printf("%d\t%lu\t%.1f\t%.1f\t%.2f\n", intervals, db.m_btree.nodes(), tree, btree, tree / btree);
+	delete[] leases;
+	delete[] addrs;
+}
+
+int main(int argc, char *argv[])
+{
+	srand48(1);
+	printf("intervals\tbtree_nodes\tns_2_3_tree\tns_btree\tspeedup\n");
+	run(100000);
+	run(1000000);
+	return 0;
+}
@@ -0,0 +1,35 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../server/palma-server.h"
+#include "../common/simulator.h"
+
+/* Kept apart from the clients, whose configuration items have the same
+   names as the ones of the server. */
+
+Palma *loopbackServer(const char *confname, Transport *transport, Simulator *sim)
+{
+	PalmaServer *server = new PalmaServer();
+	server->m_config.set(ConfigItem::INTERFACE, (void *) "segment");
+	if(!server->m_config.read(confname))
+	{
+		fprintf(stderr, "Invalid configuration in: %s\n", confname);
+		exit(1);
+	}
+	sim->attach(&server->m_event_loop);
+	server->begin(transport);
+	return server;
+}
+
+uint64_t loopbackServerLeased(Palma *protocol)
+{
+	PalmaServer *server = (PalmaServer *) protocol;
+	SetDatabase *dbs[] = {&server->m_db_unicast, &server->m_db_multicast, &server->m_db_unicast_64, &server->m_db_multicast_64};
+	uint64_t leased = 0;
+	for(int i=0; i<4; i++)
+	{
+		if(dbs[i]->m_root != NULL)
+			leased += dbs[i]->m_total_set.getSize() - dbs[i]->m_root->m_free_count;
+	}
+	return leased;
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../client/palma-client.h"
+#include "../common/segment.h"
+#include "../common/simulator.h"
+
+/*
+ * A server and many clients in one process, joined by a Segment and run
+ * by a Simulator, without sockets or privileges. Every client must end
+ * up bound to its own set, keep it through the renewals, and give it
+ * back when it exits. Reports the wall time taken and the frames that
+ * went through the segment.
+ */
+
+#define SERVER_CONFIG	"../configs/server.xml"
+#define CLIENT_CONFIG	"../configs/client.xml"
+#define LATENCY			50e-6
+
+Palma *loopbackServer(const char *confname, Transport *transport, Simulator *sim);
+uint64_t loopbackServerLeased(Palma *protocol);
+
+/* Answers every frame with a token twice, with the token less one, from
+   inside the delivery of the segment. */
+
+class Echo : public Palma
+{
+public:
+	uint64_t m_addr;
+	uint64_t m_peer;
+	uint64_t m_received;
+
+	Echo(Segment *segment, uint64_t addr, uint64_t peer) : m_addr(addr), m_peer(peer), m_received(0)
+	{
+		m_netitf.init(segment);
+		m_netitf.addAddr(addr);
+	}
+
+	void send(uint16_t token)
+	{
+		Packet pkt(MsgType::RELEASE, m_peer, m_addr, token);
+		AddrSet set(m_addr);
+		pkt.addMacSetPar(&set);
+		m_netitf.netsend(&pkt);
+	}
+
+	void handlePacket(PacketView *pkt)
+	{
+		m_received++;
+		if(pkt->getToken() == 0)
+			return;
+		send(pkt->getToken() - 1);
+		send(pkt->getToken() - 1);
+	}
+};
+
+/* Replies sent while the queue is full make it grow under the delivery
+   loop, after earlier traffic has moved its indexes well past the start.
+   Every round must deliver each frame once and end. */
+
+static bool checkReplies()
+{
+	Simulator sim(1);
+	EventLoop loop;
+	sim.attach(&loop);
+	Segment segment(&loop);
+	Echo a(&segment, 0x020000000001, 0x020000000002);
+	Echo b(&segment, 0x020000000002, 0x020000000001);
+	bool ok = true;
+
+	for(int i = 0; i < 20; i++)
+	{
+		for(int j = 0; j < 32; j++)
+			a.send(0);
+		sim.run(1.);
+	}
+	ok &= (b.m_received == 640);
+	for(int round = 0; round < 3; round++)
+	{
+		uint64_t sent = segment.m_sent;
+		a.m_received = b.m_received = 0;
+		for(int i = 0; i < 64 << round; i++)
+			a.send(1);
+		sim.run(1.);
+		ok &= (b.m_received == (uint64_t) 64 << round && a.m_received == (uint64_t) 128 << round
+				&& segment.m_sent - sent == (uint64_t) 192 << round);
+	}
+	printf("replies from delivery: %s\n", ok ? "ok" : "FAIL");
+	return ok;
+}
+
+static bool run(int nclients, double duration, long seed)
+{
+	Simulator sim(seed);
+	EventLoop loop;
+	sim.attach(&loop);
+	Segment segment(&loop, LATENCY);
+	Palma *server = loopbackServer(SERVER_CONFIG, &segment, &sim);
+	PalmaClient **clients = new PalmaClient *[nclients];
+	bool verbose = false;
+	char station[32];
+
+	double start = benchTime();
+	for(int i = 0; i < nclients; i++)
+	{
+		clients[i] = new PalmaClient();
+		snprintf(station, sizeof(station), "host%d", i);
+		clients[i]->m_config.set(ConfigItem::INTERFACE, (void *) "segment");
+		clients[i]->m_config.set(ConfigItem::STATION_ID, station);
+		if(!clients[i]->m_config.read(CLIENT_CONFIG))
+		{
+			fprintf(stderr, "Invalid configuration in: %s\n", CLIENT_CONFIG);
+			exit(1);
+		}
+		clients[i]->m_config.set(ConfigItem::VERBOSE, &verbose);
+		sim.attach(&clients[i]->m_event_loop);
+		clients[i]->begin(&segment);
+	}
+	sim.run(duration);
+
+	int bound = 0, overlaps = 0;
+	uint64_t leased = 0;
+	for(int i = 0; i < nclients; i++)
+	{
+		if(clients[i]->m_curstate != &clients[i]->m_bound_state)
+			continue;
+		bound++;
+		leased += clients[i]->m_assigned_set.getSize();
+		for(int j = 0; j < i; j++)
+		{
+			AddrSet both;
+			if(clients[j]->m_curstate == &clients[j]->m_bound_state
+				&& both.checkConflict(&clients[i]->m_assigned_set, &clients[j]->m_assigned_set))
+				overlaps++;
+		}
+	}
+	uint64_t server_leased = loopbackServerLeased(server);
+	for(int i = 0; i < nclients; i++)
+		clients[i]->onExit();
+	sim.run(1.);
+	uint64_t left = loopbackServerLeased(server);
+	double wall = benchTime() - start;
+
+	bool ok = (bound == nclients && overlaps == 0 && server_leased == leased && left == 0);
+	printf("%d\t%.0f\t%.2f\t%lu\t%lu\t%lu\t%d\t%d\t%lu\t%lu\t%s\n", nclients, duration, wall, sim.m_steps,
+			segment.m_sent, segment.m_delivered, bound, overlaps, leased, left, ok ? "ok" : "FAIL");
+	for(int i = 0; i < nclients; i++)
+		delete clients[i];
+	delete[] clients;
+	delete server;
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	bool ok = checkReplies();
+	printf("clients\tsim_s\twall_s\tsteps\tsent\tdelivered\tbound\toverlaps\tleased\tleft\tresult\n");
+	ok &= run(3, 10., 1);
+	ok &= run(100, 300., 1);
+	ok &= run(1000, 300., 2);
+	return ok ? 0 : 1;
+}
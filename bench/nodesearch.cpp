@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/database.h"
+#include "../common/btree.h"
+
+/*
+ * SetDatabase::search through the B+tree index with each in-node search
+ * kernel the CPU supports. The pool is the unicast one of
+ * configs/server.xml, fully leased one address at a time, so the index
+ * holds 100k intervals. Addresses are drawn from the whole pool, where
+ * the cache misses of the descent dominate, and from a window of 4k
+ * addresses whose path stays cached, which leaves the in-node search.
+ */
+
+#define POOL_ADDR		0x1ACA00000000
+#define POOL_SIZE		100000
+#define LOOKUPS			4000000
+#define HOT_WINDOW		4096
+#define ROUNDS			3
+
+static double searchCost(SetDatabase *db, uint64_t *addrs, uint64_t &check)
+{
+	double best = 0;
+	for(int r = 0; r < ROUNDS; r++)
+	{
+		check = 0;
+		double start = benchTime();
+		for(int i = 0; i < LOOKUPS; i++)
+			check += db->search(addrs[i])->getFirstAddr();
+		double ns = (benchTime() - start) * 1e9 / LOOKUPS;
+		if(r == 0 || ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+static void run(SetDatabase *db, uint64_t *addrs, const char *pattern)
+{
+	uint64_t expected = 0, check;
+	double base = 0;
+
+	for(int k = BTREE_KERNEL_SCALAR; k <= BTREE_KERNEL_AVX2; k++)
+	{
+		if(!BTreeNode::setKernel(k))
+		{
+			printf("%s\t%s\tunsupported\n", pattern, BTreeNode::kernelName(k));
+			continue;
+		}
+		double ns = searchCost(db, addrs, check);
+		if(k == BTREE_KERNEL_SCALAR)
+		{
+			expected = check;
+			base = ns;
+		}
+		else if(check != expected)
+		{
+			fprintf(stderr, "Kernel %s disagrees with scalar search\n", BTreeNode::kernelName(k));
+			exit(1);
+		}
+		printf("%s\t%s\t%.1f\t%.2f\n", pattern, BTreeNode::kernelName(k), ns, base / ns);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	Palma protocol;
+	SetDatabase db(&protocol);
+	AddrSet pool(POOL_ADDR, POOL_SIZE);
+	uint64_t *addrs = new uint64_t[LOOKUPS];
+
+	srand48(1);
+	db.setBTreeIndex(true);
+	db.init(&pool);
+	for(int i = 0; i < POOL_SIZE; i++)
+		db.findSet(1);
+
+	printf("pattern\tkernel\tns_per_search\tspeedup\n");
+	for(int i = 0; i < LOOKUPS; i++)
+		addrs[i] = POOL_ADDR + lrand48() % POOL_SIZE;
+	run(&db, addrs, "pool");
+	for(int i = 0; i < LOOKUPS; i++)
+		addrs[i] = POOL_ADDR + POOL_SIZE / 2 + lrand48() % HOT_WINDOW;
+	run(&db, addrs, "window");
+	delete[] addrs;
+	return 0;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include "bench.h"
+#include "../common/packet.h"
+#include "../common/details.h"
+
+/*
+ * Cost of validating received frames with PacketView. Global operator new
+ * is replaced to count heap allocations while parsing a mix of the frames
+ * the server and the client receive; the receive path should report 0.
+ */
+
+static uint64_t allocs;
+
+void *operator new(size_t size)
+{
+	allocs++;
+	void *p = malloc(size);
+	if(p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+#define NUM_FRAMES	6
+
+static uint8_t frames[NUM_FRAMES][MAX_PKT_SIZE];
+static int frame_len[NUM_FRAMES];
+
+static void buildFrames()
+{
+	uint8_t station_id[] = "bench-station";
+	uint8_t network_id[] = "bench-network";
+	uint8_t vendor[] = "bench-vendor";
+	AddrSet set(0x1ACA00000000, 0x400);
+	AddrSet other(0x1ACA00000200, 0x10);
+	AddrSet client(0x1ACA00100000);
+	uint64_t server = 0x020000000001;
+	uint64_t src = 0xFA0000000001;
+	Packet *pkt[NUM_FRAMES];
+
+	pkt[0] = new Packet(MsgType::DISCOVER, PALMA_MCAST, src, 1);
+	pkt[0]->addMacSetPar(&set);
+	pkt[0]->addIdPar(ParType::STATION_ID, station_id);
+	pkt[0]->addVendorPar(vendor, strlen((char *)vendor));
+	pkt[1] = new Packet(MsgType::OFFER, src, server, 1);
+	pkt[1]->addLifetimePar(3600);
+	pkt[1]->addMacSetPar(&set);
+	pkt[1]->addIdPar(ParType::STATION_ID, station_id);
+	pkt[1]->addIdPar(ParType::NETWORK_ID, network_id);
+	pkt[1]->addClientAddrPar(&client);
+	pkt[1]->addVendorPar(vendor, strlen((char *)vendor));
+	pkt[2] = new Packet(MsgType::REQUEST, server, client.m_addr, 1);
+	pkt[2]->addMacSetPar(&set);
+	pkt[2]->addIdPar(ParType::STATION_ID, station_id);
+	pkt[3] = new Packet(MsgType::ACK, client.m_addr, server, 1, StatusCode::ASSIGN_OK);
+	pkt[3]->addIdPar(ParType::STATION_ID, station_id);
+	pkt[3]->addMacSetPar(&set);
+	pkt[3]->addLifetimePar(3600);
+	pkt[4] = new Packet(MsgType::ANNOUNCE, PALMA_MCAST, src, 1);
+	pkt[4]->addMacSetPar(&set);
+	pkt[4]->addLifetimePar(60);
+	pkt[5] = new Packet(MsgType::DEFEND, src, client.m_addr, 1);
+	pkt[5]->addLifetimePar(60);
+	pkt[5]->addMacSetPar(&set);
+	pkt[5]->addMacSetPar(&other, false);
+	for(int i = 0; i < NUM_FRAMES; i++)
+	{
+		frame_len[i] = pkt[i]->toBuffer(frames[i]);
+		delete pkt[i];
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : 1000000;
+	PacketView view;
+	uint64_t valid = 0;
+
+	buildFrames();
+	for(int i = 0; i < NUM_FRAMES; i++)
+	{
+		if(view.parse(frames[i], frame_len[i]) != 0)
+		{
+			printf("Frame %d rejected\n", i);
+			return 1;
+		}
+	}
+
+	allocs = 0;
+	double start = benchTime();
+	for(int r = 0; r < rounds; r++)
+		for(int i = 0; i < NUM_FRAMES; i++)
+			valid += (view.parse(frames[i], frame_len[i]) == 0);
+	double elapsed = benchTime() - start;
+
+	printf("frames\tns_per_frame\tallocs_per_frame\n");
+	printf("%lu\t%.1f\t%.3f\n", valid, elapsed * 1e9 / valid, (double) allocs / valid);
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/database.h"
+#include "../common/policy.h"
+
+/*
+ * Replay of a Poisson arrive/depart workload, as in test/test-perfo.py,
+ * against each allocation policy. Requests arrive at rate LAMBDA_IN and
+ * hold their lease for an exponential time, for 1 to 256 addresses with a
+ * log-uniform size, so that the offered load is set by the departure
+ * rate. Every policy replays the same workload. Reports the time per
+ * allocation, the requests that could not get all the addresses they
+ * asked for, and the external fragmentation, 1 - largest free set / free
+ * addresses, averaged after every arrival.
+ */
+
+#define POOL_ADDR		0x1ACA00000000
+#define POOL_SIZE		65536
+#define MEAN_SIZE		28.9
+#define LAMBDA_IN		10.0
+#define ARRIVALS		400000
+#define WARMUP			40000
+
+struct Departure
+{
+	double m_time;
+	AssignableSet *m_set;
+};
+
+static Departure *heap;
+static int heap_len;
+
+static void heapPush(double time, AssignableSet *set)
+{
+	int i = heap_len++;
+	while(i > 0 && heap[(i - 1) / 2].m_time > time)
+	{
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i].m_time = time;
+	heap[i].m_set = set;
+}
+
+static void heapPop()
+{
+	Departure last = heap[--heap_len];
+	int i = 0, child;
+	while((child = 2 * i + 1) < heap_len)
+	{
+		if(child + 1 < heap_len && heap[child + 1].m_time < heap[child].m_time)
+			child++;
+		if(heap[child].m_time >= last.m_time)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = last;
+}
+
+static double exponential(double rate)
+{
+	return -log(1 - drand48()) / rate;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+static void run(const char *name, double load)
+{
+	Palma protocol;
+	SetDatabase db(&protocol);
+	AddrSet pool(POOL_ADDR, POOL_SIZE);
+	double *ns = new double[ARRIVALS - WARMUP];
+	double now = 0, frag = 0;
+	uint64_t failed = 0, empty = 0;
+
+	heap = new Departure[ARRIVALS];
+	heap_len = 0;
+	db.setPolicy(AllocPolicy::create(name));
+	db.init(&pool);
+	srand48(1);
+	for(int i = 0; i < ARRIVALS; i++)
+	{
+		now += exponential(LAMBDA_IN);
+		uint64_t count = 1 + lrand48() % ((uint64_t) 1 << (lrand48() % 9));
+		double hold = exponential(LAMBDA_IN * MEAN_SIZE / (POOL_SIZE * load));
+		while(heap_len > 0 && heap[0].m_time <= now)
+		{
+			db.release(heap[0].m_set);
+			heapPop();
+		}
+		double start = benchTime();
+		AssignableSet *set = db.findSet(count);
+		double elapsed = benchTime() - start;
+		if(set != NULL)
+			heapPush(now + hold, set);
+		if(i < WARMUP)
+			continue;
+		ns[i - WARMUP] = elapsed * 1e9;
+		if(set == NULL || set->getSize() < count)
+			failed++;
+		if(set == NULL)
+			empty++;
+		if(db.m_root->m_free_count > 0)
+			frag += 1 - (double) db.m_root->m_max_free / db.m_root->m_free_count;
+	}
+	int n = ARRIVALS - WARMUP;
+	double sum = 0;
+	for(int i = 0; i < n; i++)
+		sum += ns[i];
+	qsort(ns, n, sizeof(double), compareDouble);
+	printf("%.2f\t%s\t%.1f\t%.1f\t%.3f\t%.3f\t%.3f\n", load, name, sum / n, ns[n * 99 / 100],
+			100. * failed / n, 100. * empty / n, frag / n);
+	delete[] heap;
+	delete[] ns;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *policies[] = {"first-fit", "best-fit", "worst-fit", "aligned-fit", "next-fit"};
+	double loads[] = {0.7, 0.9, 1.0};
+
+	printf("load\tpolicy\tns_mean\tns_p99\tfail_%%\tnone_%%\tfrag\n");
+	for(int l = 0; l < 3; l++)
+	{
+		for(int p = 0; p < 5; p++)
+			run(policies[p], loads[l]);
+	}
+	return 0;
+}
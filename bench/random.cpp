@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/database.h"
+
+/*
+ * Random free set picking of SetDatabase::getFreeSet(). The pool is split
+ * into leases of 1 to 64 addresses and every other one released, leaving
+ * free sets of random sizes. A chi-square test then checks that the sets
+ * large enough for the request are drawn in proportion to their size, and
+ * the cost of a pick is compared with a weighted walk of the free list,
+ * which is what a random pick costs without the free counts of the tree.
+ */
+
+#define POOL_ADDR		0x1ACA00000000
+#define MAX_LEASE		64
+#define DRAWS			2000000
+#define PICKS			20000
+#define SCAN_PICKS		500
+
+static void split(SetDatabase *db, uint64_t pool_size)
+{
+	AddrSet pool(POOL_ADDR, pool_size);
+	AssignableSet **leases = new AssignableSet *[pool_size];
+	uint64_t n = 0;
+	db->init(&pool);
+	while((leases[n] = db->findSet(1 + lrand48() % MAX_LEASE)) != NULL)
+		n++;
+	for(uint64_t i = 1; i < n; i += 2)
+		db->release(leases[i]);
+	delete[] leases;
+}
+
+static void uniformity(uint64_t max)
+{
+	Palma protocol;
+	SetDatabase db(&protocol);
+	uint64_t pool_size = 1000000;
+	uint32_t *hits = (uint32_t *) calloc(pool_size, sizeof(uint32_t));
+	uint64_t eligible = 0, misses = 0, sets = 0;
+	double chi2 = 0;
+
+	split(&db, pool_size);
+	for(int i = 0; i < DRAWS; i++)
+		hits[db.getFreeSet(1, max, true)->getFirstAddr() - POOL_ADDR]++;
+	for(uint64_t addr = POOL_ADDR; addr < POOL_ADDR + pool_size; )
+	{
+		AssignableSet *set = db.search(addr);
+		if(set->m_next_free != NULL && set->getSize() >= max)
+			eligible += set->getSize();
+		addr = set->getLastAddr() + 1;
+	}
+	for(uint64_t addr = POOL_ADDR; addr < POOL_ADDR + pool_size; )
+	{
+		AssignableSet *set = db.search(addr);
+		uint32_t n = hits[addr - POOL_ADDR];
+		if(set->m_next_free != NULL && set->getSize() >= max)
+		{
+			double expected = (double) DRAWS * set->getSize() / eligible;
+			chi2 += (n - expected) * (n - expected) / expected;
+			sets++;
+		}
+		else
+			misses += n;
+		addr = set->getLastAddr() + 1;
+	}
+	double z = (chi2 - (sets - 1)) / sqrt(2. * (sets - 1));
+	printf("%lu\t%lu\t%.1f\t%.2f\t%lu\t%s\n", max, sets, chi2, z, misses,
+			(fabs(z) < 4 && misses == 0) ? "ok" : "FAIL");
+	free(hits);
+}
+
+static AssignableSet *scanPick(SetDatabase *db, uint64_t size)
+{
+	AssignableSet *p = db->m_free_list;
+	uint64_t total = 0;
+	do
+	{
+		if(p->getSize() >= size)
+			total += p->getSize();
+		p = p->m_next_free;
+	} while(p != db->m_free_list);
+	uint64_t offset = (lrand48() ^ ((uint64_t) lrand48() << 31)) % total;
+	for(;; p = p->m_next_free)
+	{
+		if(p->getSize() < size)
+			continue;
+		if(offset < p->getSize())
+			return p;
+		offset -= p->getSize();
+	}
+}
+
+static void cost(uint64_t pool_size)
+{
+	Palma protocol;
+	SetDatabase db(&protocol);
+	uint64_t check = 0;
+
+	split(&db, pool_size);
+	double start = benchTime();
+	for(int i = 0; i < PICKS; i++)
+		check += db.getFreeSet(1, 32, true)->getFirstAddr();
+	double tree = (benchTime() - start) * 1e9 / PICKS;
+	start = benchTime();
+	for(int i = 0; i < SCAN_PICKS; i++)
+		check += scanPick(&db, 32)->getFirstAddr();
+	double scan = (benchTime() - start) * 1e9 / SCAN_PICKS;
+	printf("%lu\t%lu\t%.1f\t%.1f\t%.1f\n", pool_size, db.m_set_pool.m_in_use / 2, tree, scan, scan / tree);
+	if(check == 0)
+		printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	srand48(1);
+	printf("max\tsets\tchi2\tz\tmisses\tresult\n");
+	uniformity(1);
+	uniformity(32);
+	printf("\npool\tfree_sets\tns_tree\tns_scan\tspeedup\n");
+	cost(100000);
+	cost(1000000);
+	cost(10000000);
+	return 0;
+}
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "../common/packet.h"
+#include "../common/details.h"
+
+/*
+ * Cost of serializing an OFFER, building a Packet per response as the
+ * server used to do against patching a PacketTemplate. Both frames are
+ * parsed back and compared before timing.
+ */
+
+static uint8_t station_id[] = "bench-station";
+static uint8_t network_id[] = "bench-network";
+static uint8_t vendor[] = "bench-vendor";
+
+static uint64_t server = 0x020000000001;
+
+static int buildOffer(uint8_t *buf, uint64_t DA, uint16_t token, AddrSet *set, AddrSet *client)
+{
+	Packet pkt(MsgType::OFFER, DA, server, token);
+	pkt.addLifetimePar(3600);
+	pkt.addMacSetPar(set);
+	pkt.addIdPar(ParType::STATION_ID, station_id, strlen((char *)station_id));
+	pkt.addIdPar(ParType::NETWORK_ID, network_id);
+	pkt.addClientAddrPar(client);
+	pkt.addVendorPar(vendor, strlen((char *)vendor));
+	return pkt.toBuffer(buf);
+}
+
+static bool sameOffer(PacketView *a, PacketView *b)
+{
+	return a->getDA() == b->getDA() && a->getSA() == b->getSA()
+			&& a->getToken() == b->getToken() && a->getLifetime() == b->getLifetime()
+			&& a->getSet()->getFirstAddr() == b->getSet()->getFirstAddr()
+			&& a->getSet()->getSize() == b->getSet()->getSize()
+			&& a->getClientAddr() == b->getClientAddr()
+			&& a->getStationIdLen() == b->getStationIdLen()
+			&& memcmp(a->getStationId(), b->getStationId(), a->getStationIdLen()) == 0
+			&& a->getNetworkIdLen() == b->getNetworkIdLen()
+			&& a->getVendorVarLen() == b->getVendorVarLen()
+			&& a->getFrameLen() == b->getFrameLen();
+}
+
+int main(int argc, char *argv[])
+{
+	int rounds = argc > 1 ? atoi(argv[1]) : 1000000;
+	uint8_t buf[MAX_PKT_SIZE];
+	AddrSet set(0x1ACA00000000, 0x400);
+	AddrSet client(0x1ACA00100000);
+	PacketTemplate tpl;
+	PacketView a, b;
+	uint64_t sum = 0;
+	int len;
+
+	tpl.init(MsgType::OFFER, server);
+	tpl.addIdPar(ParType::NETWORK_ID, network_id);
+	tpl.addVendorPar(vendor, strlen((char *)vendor));
+
+	len = buildOffer(buf, 0xFA0000000001, 7, &set, &client);
+	int tpl_len = tpl.fill(0xFA0000000001, 7, StatusCode::NO_CODE, &set, 3600,
+							station_id, strlen((char *)station_id), &client);
+	if(a.parse(buf, len) != 0 || b.parse(tpl.getData(), tpl_len) != 0 || !sameOffer(&a, &b))
+	{
+		printf("Template and packet offers differ\n");
+		return 1;
+	}
+
+	double start = benchTime();
+	for(int i = 0; i < rounds; i++)
+		sum += buildOffer(buf, 0xFA0000000001 + i, i, &set, &client);
+	double packet_ns = (benchTime() - start) * 1e9 / rounds;
+
+	start = benchTime();
+	for(int i = 0; i < rounds; i++)
+		sum += tpl.fill(0xFA0000000001 + i, i, StatusCode::NO_CODE, &set, 3600,
+						station_id, strlen((char *)station_id), &client);
+	double tpl_ns = (benchTime() - start) * 1e9 / rounds;
+
+	printf("path\tns_per_offer\n");
+	printf("packet\t%.1f\n", packet_ns);
+	printf("template\t%.1f\n", tpl_ns);
+	printf("speedup\t%.2f\t(%lu)\n", packet_ns / tpl_ns, sum);
+	return 0;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <linux/if_packet.h>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/details.h"
+
+/*
+ * Receive path throughput over a veth pair (or any two interfaces on the
+ * same segment). A child process floods DISCOVER frames on the peer
+ * interface while the parent counts the frames handed to the protocol,
+ * first through recvmmsg and then through the TPACKET_V3 ring.
+ * Needs root.
+ */
+
+class RxCounter : public Palma
+{
+public:
+	uint64_t m_frames;
+
+	RxCounter() : m_frames(0) {}
+	void handleBatch(PacketView **pkts, int n) { m_frames += n; }
+};
+
+class StopTimer : public Timer
+{
+public:
+	void timeout() { EventLoop::m_finalize = true; }
+};
+
+static void flood(const char *ifname)
+{
+	uint8_t buf[MAX_PKT_SIZE];
+	ifreq ifbuf = {0};
+	sockaddr_ll saddr = {0};
+	int fd = socket(PF_PACKET, SOCK_RAW, htons(PALMA_TYPE));
+
+	strncpy(ifbuf.ifr_name, ifname, IFNAMSIZ);
+	if(fd < 0 || ioctl(fd, SIOCGIFINDEX, &ifbuf) < 0)
+	{
+		perror("Opening flood socket");
+		exit(1);
+	}
+	saddr.sll_family = AF_PACKET;
+	saddr.sll_ifindex = ifbuf.ifr_ifindex;
+	saddr.sll_halen = ETH_ALEN;
+	if(bind(fd, (sockaddr*)&saddr, sizeof(saddr)) < 0)
+	{
+		perror("Binding flood socket");
+		exit(1);
+	}
+	Packet pkt(MsgType::DISCOVER, PALMA_MCAST, 0x2a0000000001, 1);
+	pkt.addIdPar(ParType::STATION_ID, (uint8_t *)"bench");
+	int len = pkt.toBuffer(buf);
+	for(;;)
+		send(fd, buf, len, 0);
+}
+
+static double measure(const char *rx_itf, const char *tx_itf, bool ring, double secs, int batch)
+{
+	RxCounter counter;
+	StopTimer stop;
+
+	counter.m_netitf.setRxRing(ring);
+	counter.m_netitf.setBatchSize(batch);
+	counter.m_netitf.init((uint8_t *)rx_itf);
+	counter.m_netitf.addAddr(PALMA_MCAST, true);
+	counter.m_event_loop.regSource(&counter.m_netitf);
+
+	pid_t pid = fork();
+	if(pid == 0)
+		flood(tx_itf);
+	EventLoop::m_finalize = false;
+	double start = benchTime();
+	counter.m_event_loop.startTimer(&stop, secs);
+	counter.m_event_loop.run();
+	double elapsed = benchTime() - start;
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	printf("%s\t%d\t%lu\t%.2f\t%.0f\n", ring ? "ring" : "recvmmsg", batch, counter.m_frames,
+			counter.m_netitf.m_rx_wakeups ? (double) counter.m_netitf.m_rx_frames / counter.m_netitf.m_rx_wakeups : 0.,
+			counter.m_frames / elapsed);
+	return counter.m_frames / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+	char *rx_itf = NULL;
+	char *tx_itf = NULL;
+	double secs = 2.;
+	int batch = DEFAULT_RX_BATCH;
+
+	while ((c = getopt (argc, argv, "i:p:t:b:")) != -1)
+	{
+		switch (c)
+		{
+			case 'i':
+				rx_itf = optarg;
+				break;
+			case 'p':
+				tx_itf = optarg;
+				break;
+			case 't':
+				secs = atof(optarg);
+				break;
+			case 'b':
+				batch = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr,"Uso:%s -i <rx interface> -p <peer interface> [-t <seconds>][-b <batch>]\n", argv[0]);
+				exit(1);
+		}
+	}
+	if(rx_itf == NULL || tx_itf == NULL)
+	{
+		fprintf(stderr,"Uso:%s -i <rx interface> -p <peer interface> [-t <seconds>][-b <batch>]\n", argv[0]);
+		exit(1);
+	}
+	printf("path\tbatch\tframes\tframes_per_wakeup\tframes_per_s\n");
+	double recv_rate = measure(rx_itf, tx_itf, false, secs, batch);
+	double ring_rate = measure(rx_itf, tx_itf, true, secs, batch);
+	printf("ring/recvmmsg\t%.2f\n", recv_rate > 0 ? ring_rate / recv_rate : 0.);
+	return 0;
+}
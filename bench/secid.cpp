@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/database.h"
+
+/*
+ * Cost of finding the lease of a client in a SetDatabase holding n leases,
+ * by address through checkStatus() against by security id through
+ * checkLease(). The leases are single addresses with random security ids
+ * and the same random leases are looked up both ways.
+ */
+
+#define POOL_ADDR		0x1ACA00000000
+#define LOOKUPS			2000000
+
+static uint64_t randomId()
+{
+	return ((uint64_t) mrand48() << 32) ^ (uint32_t) mrand48();
+}
+
+static double lookupCost(SetDatabase *db, AssignableSet **leases, int *picks, bool by_id, uint64_t &check)
+{
+	uint64_t security_id;
+	uint16_t lifetime;
+	bool identical;
+	AssignableSet *result;
+	double start = benchTime();
+	for(int i = 0; i < LOOKUPS; i++)
+	{
+		AssignableSet *lease = leases[picks[i]];
+		AddrSet set(lease->getFirstAddr());
+		if(by_id)
+			db->checkLease(lease->m_security_id, &set, lifetime, identical, result);
+		else
+			db->checkStatus(&set, security_id, lifetime, identical, result);
+		check += result->getFirstAddr();
+	}
+	return (benchTime() - start) * 1e9 / LOOKUPS;
+}
+
+static void run(int n)
+{
+	Palma protocol;
+	SetDatabase db(&protocol);
+	AddrSet pool(POOL_ADDR, n + 1);
+	AssignableSet **leases = new AssignableSet *[n];
+	int *picks = new int[LOOKUPS];
+	uint64_t check_addr = 0, check_id = 0;
+
+	db.init(&pool);
+	for(int i = 0; i < n; i++)
+		leases[i] = db.reserve(1, randomId(), 60);
+	for(int i = 0; i < LOOKUPS; i++)
+		picks[i] = lrand48() % n;
+
+	double by_addr = lookupCost(&db, leases, picks, false, check_addr);
+	double by_id = lookupCost(&db, leases, picks, true, check_id);
+	if(check_addr != check_id)
+	{
+		fprintf(stderr, "Lookups disagree\n");
+		exit(1);
+	}
+	printf("%d\t%lu\t%.1f\t%.1f\t%.2f\n", n, db.m_id_size, by_addr, by_id, by_addr / by_id);
+	delete[] leases;
+	delete[] picks;
+}
+
+int main(int argc, char *argv[])
+{
+	srand48(1);
+	printf("leases\tbuckets\tns_by_addr\tns_by_id\tspeedup\n");
+	run(1000);
+	run(100000);
+	run(1000000);
+	return 0;
+}
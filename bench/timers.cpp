@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "../common/timer.h"
+
+#define MAX_LIST_TIMERS	20000
+
+/*
+ * Copy of the delta list the TimerList used to be, kept here as the
+ * reference the heap is measured against.
+ */
+
+class DeltaTimer
+{
+public:
+	double m_duration;
+	DeltaTimer *m_next;
+	bool active;
+
+	DeltaTimer() : m_duration(0), m_next(NULL), active(false) {}
+};
+
+class DeltaList
+{
+public:
+	Time m_ref;
+	DeltaTimer m_first;
+
+	void refresh()
+	{
+		Time now;
+		if(m_first.m_next != NULL)
+			m_first.m_next->m_duration -= now.elapsed(m_ref);
+		m_ref = now;
+	}
+
+	double read(DeltaTimer *timer)
+	{
+		if(!timer->active)
+			return 0.;
+		double time = 0.;
+		refresh();
+		for(DeltaTimer *p = m_first.m_next; p != timer && p != NULL; p = p->m_next)
+			time += p->m_duration;
+		return time + timer->m_duration;
+	}
+
+	void add(DeltaTimer *newtimer)
+	{
+		refresh();
+		newtimer->active = true;
+		for(DeltaTimer *p = &m_first;; p = p->m_next)
+		{
+			if(p->m_next == NULL)
+			{
+				p->m_next = newtimer;	
+				newtimer->m_next = NULL;
+				return;
+			}
+			else if(newtimer->m_duration < p->m_next->m_duration)
+			{
+				p->m_next->m_duration -= newtimer->m_duration;  
+				newtimer->m_next = p->m_next;
+				p->m_next = newtimer;
+				return;	
+			}
+			else
+				newtimer->m_duration -= p->m_next->m_duration;
+		}
+	}
+
+	void del(DeltaTimer *timer)
+	{
+		DeltaTimer *p;
+		double left = 0.;
+		if(!timer->active)
+			return;
+		refresh();
+		for(p = &m_first; p->m_next != timer; p = p->m_next)
+		{
+			if(p->m_next == NULL) return;
+			left += p->m_next->m_duration;
+		}
+		if(timer->m_next != NULL)
+			timer->m_next->m_duration += timer->m_duration;
+		p->m_next = timer->m_next;
+		timer->active = false;
+		timer->m_duration += left;
+	}
+};
+
+static int *shuffle(int n)
+{
+	int *order = new int[n];
+	for(int i=0; i<n; i++)
+		order[i] = i;
+	for(int i=n-1; i>0; i--)
+	{
+		int j = lrand48() % (i + 1);
+		int aux = order[i];
+		order[i] = order[j];
+		order[j] = aux;
+	}
+	return order;
+}
+
+/* Lease like durations: lifetimes up to one hour */
+
+template <class T, class L> void run(const char *name, int n)
+{
+	L list;
+	T *timers = new T[n];
+	int *order = shuffle(n);
+	double start, add, read, del;
+	volatile double left = 0.;
+
+	for(int i=0; i<n; i++)
+		timers[i].m_duration = 1. + drand48() * 3600.;
+	start = benchTime();
+	for(int i=0; i<n; i++)
+		list.add(&timers[i]);
+	add = benchTime() - start;
+	start = benchTime();
+	for(int i=0; i<n; i++)
+		left += list.read(&timers[order[i]]);
+	read = benchTime() - start;
+	start = benchTime();
+	for(int i=0; i<n; i++)
+		list.del(&timers[order[i]]);
+	del = benchTime() - start;
+	printf("%s\t%d\t%.1f\t%.1f\t%.1f\n", name, n, add / n * 1e9, read / n * 1e9, del / n * 1e9);
+	delete[] order;
+	delete[] timers;
+}
+
+int main(int argc, char *argv[])
+{
+	int max_timers = argc > 1 ? atoi(argv[1]) : 1000000;
+
+	srand48(1);
+	printf("list\ttimers\tns_per_add\tns_per_read\tns_per_del\n");
+	for(int n = 1000; n <= max_timers; n *= 10)
+	{
+		if(n <= MAX_LIST_TIMERS)
+			run<DeltaTimer, DeltaList>("delta", n);
+		run<Timer, TimerList>("heap", n);
+	}
+	return 0;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bench.h"
+#include "../common/palma.h"
+#include "../common/database.h"
+#include "../common/simulator.h"
+
+/*
+ * A day of lease traffic on a virtual clock. Sessions arrive as a Poisson
+ * process, take a lease, renew it at half its lifetime a random number of
+ * times and then release it or let it expire. Everything runs on the
+ * timers of a Simulator, so the day takes as long as its events need.
+ * The run is repeated with the same seed and must end in the same state.
+ */
+
+#define POOL_ADDR		0x1ACA00000000
+#define POOL_SIZE		100000
+#define LAMBDA_IN		10.0
+#define LIFETIME		60
+#define MAX_RENEWALS	20
+#define SIM_TIME		86400.
+
+static uint64_t sessions;
+
+class Session : public Timer
+{
+	SetDatabase *m_db;
+	AssignableSet *m_set;
+	int m_renewals;
+
+public:
+	Session(SetDatabase *db, AssignableSet *set) : m_db(db), m_set(set), m_renewals(lrand48() % MAX_RENEWALS) {}
+
+	void timeout()
+	{
+		if(m_renewals-- > 0)
+		{
+			m_db->renew(m_set, LIFETIME);
+			m_db->m_protocol->m_event_loop.startTimer(this, LIFETIME / 2);
+			return;
+		}
+		if(lrand48() % 2)
+			m_db->release(m_set);
+		sessions--;
+		delete this;
+	}
+};
+
+class Arrivals : public Timer
+{
+	SetDatabase *m_db;
+
+public:
+	uint64_t m_leases;
+	uint64_t m_refused;
+	bool m_stop;
+
+	Arrivals(SetDatabase *db) : m_db(db), m_leases(0), m_refused(0), m_stop(false) {}
+
+	void timeout()
+	{
+		if(m_stop)
+			return;
+		AssignableSet *set = m_db->reserve(1 + lrand48() % 16, m_leases, LIFETIME);
+		if(set != NULL)
+		{
+			Session *s = new Session(m_db, set);
+			m_db->m_protocol->m_event_loop.startTimer(s, LIFETIME / 2);
+			sessions++;
+			m_leases++;
+		}
+		else
+			m_refused++;
+		m_db->m_protocol->m_event_loop.startTimer(this, -log(1 - drand48()) / LAMBDA_IN);
+	}
+};
+
+static uint64_t digest(SetDatabase *db)
+{
+	uint64_t h = 0xcbf29ce484222325;
+	for(uint64_t addr = POOL_ADDR; addr < POOL_ADDR + POOL_SIZE; )
+	{
+		AssignableSet *set = db->search(addr);
+		h = (h ^ set->getFirstAddr() ^ (set->getSize() << 40) ^ (set->m_next_free != NULL)) * 0x100000001b3;
+		addr = set->getLastAddr() + 1;
+	}
+	return h;
+}
+
+static uint64_t run(long seed)
+{
+	Simulator sim(seed);
+	Palma protocol;
+	SetDatabase db(&protocol);
+	AddrSet pool(POOL_ADDR, POOL_SIZE);
+	Arrivals arrivals(&db);
+
+	sim.attach(&protocol.m_event_loop);
+	db.init(&pool);
+	protocol.m_event_loop.startTimer(&arrivals, 0.001);
+	double start = benchTime();
+	sim.run(SIM_TIME);
+	double wall = benchTime() - start;
+	uint64_t h = digest(&db);
+	printf("%ld\t%.0f\t%.2f\t%.0f\t%lu\t%lu\t%lu\t%lu\t%016lx\n", seed, sim.now(), wall, SIM_TIME / wall,
+			sim.m_steps, arrivals.m_leases, arrivals.m_refused, db.m_expired, h);
+
+	arrivals.m_stop = true;
+	while(sim.step())
+		;
+	if(sessions != 0 || db.m_root->m_free_count != POOL_SIZE)
+		printf("LEFT %lu sessions, %lu addresses leased\n", sessions, POOL_SIZE - db.m_root->m_free_count);
+	sim.detach(&protocol.m_event_loop);
+	return h;
+}
+
+int main(int argc, char *argv[])
+{
+	printf("seed\tsim_s\twall_s\tspeedup\tsteps\tleases\trefused\texpired\tdigest\n");
+	uint64_t a = run(1);
+	uint64_t b = run(1);
+	uint64_t c = run(2);
+	printf("same seed: %s, other seed: %s\n", a == b ? "identical" : "DIFFERENT", a != c ? "different" : "SAME");
+	return 0;
+}
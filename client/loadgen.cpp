@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "palma-client.h"
+#include "../common/segment.h"
+
+/*
+ * Many PALMA clients in one process, as test/test-perfo.py does with one
+ * palma-client per mininet host. Clients arrive as a Poisson process of
+ * rate lambda_in while there are idle ones, and each stays for an
+ * exponential time of rate lambda_out, or until the end when it is 0.
+ * All of them run on one event loop and share a Segment, bridged to the
+ * interface through a single promiscuous socket. Unless asked to, the
+ * clients do not hear each other, which would cost this process as much
+ * as all of them together. Every client leaving writes a record with the
+ * time it took to get its set.
+ */
+
+class Loadgen;
+
+class LoadClient : public PalmaClient, public Timer
+{
+public:
+	Loadgen *m_gen;
+	int m_slot;
+	double m_arrive;
+	double m_assigned;
+	uint64_t m_renewals;
+
+	LoadClient(Loadgen *gen, int slot);
+	void onAssigned();
+	void timeout();
+};
+
+class Loadgen : public Palma, public Timer
+{
+	class FinishTimer : public Timer
+	{
+	public:
+		Loadgen *m_gen;
+		FinishTimer(Loadgen *gen) : m_gen(gen) {}
+		void timeout() {m_gen->onExit();}
+	};
+
+	TimerList m_timers;
+	Segment m_segment;
+	FinishTimer m_finish_timer;
+	LoadClient **m_clients;
+	int *m_idle;
+	int m_nidle;
+	int m_nclients;
+	const char *m_itfname;
+	const char *m_confname;
+	double m_lambda_in;
+	double m_lambda_out;
+	double m_start;
+	FILE *m_out;
+	double *m_latency;
+	uint64_t m_latency_size;
+
+public:
+	uint64_t m_arrivals;
+	uint64_t m_refused;
+	uint64_t m_bound;
+	uint64_t m_auto;
+	uint64_t m_departures;
+
+	Loadgen(int nclients, const char *confname, double lambda_in, double lambda_out, FILE *out);
+	~Loadgen();
+	void begin(const char *itfname, double test_time, bool local);
+	void handleBatch(PacketView **pkts, int n);
+	void timeout();
+	void assigned(LoadClient *client);
+	void depart(LoadClient *client);
+	void onExit();
+	double now();
+	void summary();
+	static double exponential(double rate);
+};
+
+LoadClient::LoadClient(Loadgen *gen, int slot) : m_gen(gen),
+												m_slot(slot),
+												m_arrive(gen->now()),
+												m_assigned(-1),
+												m_renewals(0) {}
+
+void LoadClient::onAssigned()
+{
+	if(m_assigned >= 0)
+	{
+		m_renewals++;
+		return;
+	}
+	m_assigned = m_gen->now();
+	m_gen->assigned(this);
+}
+
+void LoadClient::timeout()
+{
+	m_gen->depart(this);
+}
+
+Loadgen::Loadgen(int nclients, const char *confname, double lambda_in, double lambda_out, FILE *out) :
+								m_segment(&m_event_loop),
+								m_finish_timer(this),
+								m_nclients(nclients),
+								m_itfname(NULL),
+								m_confname(confname),
+								m_lambda_in(lambda_in),
+								m_lambda_out(lambda_out),
+								m_out(out),
+								m_latency(NULL),
+								m_latency_size(0),
+								m_arrivals(0),
+								m_refused(0),
+								m_bound(0),
+								m_auto(0),
+								m_departures(0)
+{
+	m_clients = new LoadClient *[nclients];
+	m_idle = new int[nclients];
+	for(int i = 0; i < nclients; i++)
+	{
+		m_clients[i] = NULL;
+		m_idle[i] = nclients - 1 - i;
+	}
+	m_nidle = nclients;
+	m_event_loop.setTimerList(&m_timers);
+	m_start = Clock::read();
+}
+
+Loadgen::~Loadgen()
+{
+	delete[] m_clients;
+	delete[] m_idle;
+	free(m_latency);
+}
+
+void Loadgen::begin(const char *itfname, double test_time, bool local)
+{
+	m_itfname = itfname;
+	m_netitf.init((uint8_t *) itfname);
+	m_netitf.setPromiscuous();
+	m_segment.setUplink(&m_netitf, local);
+	m_event_loop.regSource(&m_netitf);
+	m_event_loop.regHandler(this);
+	fprintf(m_out, "HOST,ARRIVE,ASSIGNED,LATENCY_MS,STATE,ADDR,COUNT,RENEWALS,DEPART\n");
+	m_event_loop.startTimer(this, exponential(m_lambda_in));
+	if(test_time > 0)
+		m_event_loop.startTimer(&m_finish_timer, test_time);
+	m_event_loop.run();
+}
+
+void Loadgen::handleBatch(PacketView **pkts, int n)
+{
+	for(int i = 0; i < n; i++)
+		m_segment.inject(pkts[i]->getData(), pkts[i]->getFrameLen());
+}
+
+double Loadgen::now()
+{
+	return Clock::read() - m_start;
+}
+
+double Loadgen::exponential(double rate)
+{
+	return -log(1 - drand48()) / rate;
+}
+
+/* Arrival of a client, if there is any idle one left. */
+
+void Loadgen::timeout()
+{
+	m_event_loop.startTimer(this, exponential(m_lambda_in));
+	if(m_nidle == 0)
+	{
+		m_refused++;
+		return;
+	}
+	int slot = m_idle[--m_nidle];
+	char station[32];
+	bool verbose = false;
+	LoadClient *client = new LoadClient(this, slot);
+
+	snprintf(station, sizeof(station), "H%d", slot + 1);
+	client->m_config.set(ConfigItem::INTERFACE, (void *) m_itfname);
+	client->m_config.set(ConfigItem::STATION_ID, station);
+	if(m_confname && !client->m_config.read(m_confname))
+	{
+		fprintf(stderr, "Invalid configuration in: %s\n", m_confname);
+		exit(1);
+	}
+	client->m_config.set(ConfigItem::VERBOSE, &verbose);
+	client->m_event_loop.setTimerList(&m_timers);
+	m_clients[slot] = client;
+	m_arrivals++;
+	client->begin(&m_segment);
+	if(m_lambda_out > 0)
+		client->m_event_loop.startTimer(client, exponential(m_lambda_out));
+}
+
+void Loadgen::assigned(LoadClient *client)
+{
+	if(client->m_curstate == &client->m_bound_state)
+		m_bound++;
+	else
+		m_auto++;
+	if(m_bound + m_auto > m_latency_size)
+	{
+		m_latency_size = m_latency_size ? 2 * m_latency_size : 1024;
+		m_latency = (double *) realloc(m_latency, m_latency_size * sizeof(double));
+		if(m_latency == NULL)
+		{
+			perror("Growing latency records");
+			exit(1);
+		}
+	}
+	m_latency[m_bound + m_auto - 1] = (client->m_assigned - client->m_arrive) * 1e3;
+}
+
+void Loadgen::depart(LoadClient *client)
+{
+	const char *state = "NONE";
+	if(client->m_assigned >= 0)
+		state = (client->m_curstate == &client->m_bound_state) ? "SERVER" : "AUTO";
+	fprintf(m_out, "H%d,%.6f,", client->m_slot + 1, client->m_arrive);
+	if(client->m_assigned >= 0)
+		fprintf(m_out, "%.6f,%.3f,", client->m_assigned, (client->m_assigned - client->m_arrive) * 1e3);
+	else
+		fprintf(m_out, ",,");
+	fprintf(m_out, "%s,0x%lx,0x%lx,%lu,%.6f\n", state, client->m_assigned_set.getFirstAddr(),
+			client->m_assigned_set.getSize(), client->m_renewals, now());
+	client->m_event_loop.stopTimer(client);
+	client->onExit();
+	m_clients[client->m_slot] = NULL;
+	m_idle[m_nidle++] = client->m_slot;
+	m_departures++;
+	delete client;
+}
+
+/* At the end of the test, or on a signal, every client still there leaves
+   as palma-client does, releasing its set. */
+
+void Loadgen::onExit()
+{
+	m_event_loop.stopTimer(this);
+	for(int i = 0; i < m_nclients; i++)
+	{
+		if(m_clients[i] != NULL)
+			depart(m_clients[i]);
+	}
+	EventLoop::m_finalize = true;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+void Loadgen::summary()
+{
+	uint64_t n = m_bound + m_auto;
+	fprintf(stderr, "%lu arrivals, %lu refused, %lu departures, %lu server assigned, %lu auto assigned\n",
+			m_arrivals, m_refused, m_departures, m_bound, m_auto);
+	fprintf(stderr, "%lu frames sent, %lu delivered, %lu from the link\n",
+			m_segment.m_sent, m_segment.m_delivered, m_netitf.m_rx_frames);
+	if(n == 0)
+		return;
+	qsort(m_latency, n, sizeof(double), compareDouble);
+	fprintf(stderr, "latency ms: p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+			m_latency[n / 2], m_latency[n * 9 / 10], m_latency[n * 99 / 100], m_latency[n - 1]);
+}
+
+#define USAGE	"Uso:%s -i <interface name> [-c <config filename>][-n <clients>][-a <lambda in>][-d <lambda out>][-t <test time>][-o <output filename>][-l]\n"
+
+int main(int argc, char *argv[])
+{
+	int c;
+	char *itfname = NULL;
+	char *confname = NULL;
+	char *outname = NULL;
+	int nclients = 1000;
+	double lambda_in = 10;
+	double lambda_out = 1. / 10;
+	double test_time = -1;
+	bool local = false;
+
+	while ((c = getopt (argc, argv, "c:i:n:a:d:t:o:l")) != -1)
+	{
+		switch (c)
+		{
+			case 'c':
+				confname = optarg;
+				break;
+			case 'i':
+				itfname = optarg;
+				break;
+			case 'n':
+				nclients = atoi(optarg);
+				break;
+			case 'a':
+				lambda_in = atof(optarg);
+				break;
+			case 'd':
+				lambda_out = atof(optarg);
+				break;
+			case 't':
+				test_time = atof(optarg);
+				break;
+			case 'o':
+				outname = optarg;
+				break;
+			case 'l':
+				local = true;
+				break;
+			case '?':
+				fprintf(stderr,"Invalid option.\n");
+				fprintf(stderr,	USAGE, argv[0]);
+				exit(1);
+			default:
+				abort();
+		}
+	}
+	if(optind != argc || itfname == NULL || nclients <= 0 || lambda_in <= 0 || lambda_out < 0)
+	{
+		fprintf(stderr,"Invalid arguments.\n");
+		fprintf(stderr,	USAGE, argv[0]);
+		exit(1);
+	}
+
+	FILE *out = stdout;
+	if(outname != NULL && (out = fopen(outname, "w")) == NULL)
+	{
+		perror("Opening output file");
+		exit(1);
+	}
+	PalmaClient::initRandom();
+	Loadgen gen(nclients, confname, lambda_in, lambda_out, out);
+	gen.begin(itfname, test_time, local);
+	gen.summary();
+	fclose(out);
+}
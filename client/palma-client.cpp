@@ -24,6 +24,22 @@ void PalmaClient::begin()
 	m_netitf.init(TO_STRING(m_config.get(ConfigItem::INTERFACE)));
 	m_event_loop.regSource(&m_netitf);
 	m_event_loop.regHandler(this);
+	setup();
+	m_event_loop.run();
+}
+
+/* Runs over a transport, inside a program that drives the event loop
+   itself. */
+
+void PalmaClient::begin(Transport *transport)
+{
+	printv("BEGIN\n");
+	m_netitf.init(transport);
+	setup();
+}
+
+void PalmaClient::setup()
+{
 	m_src_addr = TO_ADDR(m_config.get(ConfigItem::PREASSIGNED_ADDR));
 	if(m_src_addr)
 	{
@@ -37,10 +53,9 @@ void PalmaClient::begin()
 		m_requesting_state.start(m_server_addr, m_src_addr, claim_set);
 	else
 		m_discovery_state.start();
-	m_event_loop.run();
 }
 
-void PalmaClient::handlePacket(Packet *pkt)
+void PalmaClient::handlePacket(PacketView *pkt)
 {
 	m_curstate->handlePacket(pkt);
 }
@@ -68,12 +83,12 @@ void PalmaClient::restart()
 		m_discovery_state.start();
 }
 
-bool PalmaClient::checkStationId(uint8_t *station_id)
+bool PalmaClient::checkStationId(uint8_t *station_id, uint8_t len)
 {
 	uint8_t *id = TO_STRING(m_config.get(ConfigItem::STATION_ID));
 	if(station_id == NULL ||
-			(id != NULL && 
-			strcmp((const char *)station_id, (const char *)id) == 0))
+			(id != NULL && strlen((const char *)id) == len &&
+			memcmp(station_id, id, len) == 0))
 		return true;
 	return false; 
 }
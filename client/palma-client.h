@@ -26,12 +26,15 @@ public:
 
 	PalmaClient();
 	void begin();
-	void handlePacket(Packet *pkt);
+	void begin(Transport *transport);
+	void setup();
+	void handlePacket(PacketView *pkt);
 	void restart();
-	bool checkStationId(uint8_t *station_id);
+	bool checkStationId(uint8_t *station_id, uint8_t len);
 	void updateToken();	
 	uint16_t getToken();
 	void onExit();
+	virtual void onAssigned() {}
 	void printv(const char *format, ...);
 };
 
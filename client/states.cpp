@@ -52,7 +52,6 @@ void DiscoveryState::clean()
 		m_protocol->m_netitf.delAddr(m_src_addr);	
 		m_src_addr = 0;
 	}
-	delete m_offer;
 	m_offer = NULL;
 	m_discovery_set = AddrSet();
 	m_change_discovery = false;
@@ -73,12 +72,12 @@ void DiscoveryState::sendDiscover()
 	m_protocol->m_event_loop.startTimer(&m_discovery_timer, DISCOVERY_TIMEOUT);
 }
 
-void DiscoveryState::handlePacket(Packet *pkt)
+void DiscoveryState::handlePacket(PacketView *pkt)
 {
 	if((pkt->getDA() == PALMA_MCAST && pkt->getType() != MsgType::ANNOUNCE))
 		return;
 	else if((pkt->getDA() != m_src_addr 
-				|| !m_protocol->checkStationId(pkt->getStationId()))
+				|| !m_protocol->checkStationId(pkt->getStationId(), pkt->getStationIdLen()))
 				&& pkt->getType() != MsgType::ANNOUNCE)
 		return;
 	switch(pkt->getType())
@@ -121,20 +120,20 @@ uint64_t DiscoveryState::getSrcAddr()
 	return m_src_addr;
 }
 
-bool State::validSet(Packet *pkt)
+bool State::validSet(PacketView *pkt)
 {
 	return (pkt->getSet()->getSize() >= TO_SIZE(m_protocol->m_config.get(ConfigItem::MIN_ADDR_CLAIM))
 			&& (TO_ADDRSET_PTR(m_protocol->m_config.get(ConfigItem::CLAIM_SET))->isMulticast() == pkt->getSet()->isMulticast())
 			&& (TO_ADDRSET_PTR(m_protocol->m_config.get(ConfigItem::CLAIM_SET))->isSize48() == pkt->getSet()->isSize48()));
 }
 
-bool State::validOffer(Packet *pkt)
+bool State::validOffer(PacketView *pkt)
 {
 	return (validSet(pkt) && (!TO_ADDRSET_PTR(m_protocol->m_config.get(ConfigItem::CLAIM_SET))->isMulticast() 
 								|| m_protocol->m_preassigned_addr || pkt->getClientAddr()));
 }
 
-void DiscoveryState::storeOffer(Packet *pkt)
+void DiscoveryState::storeOffer(PacketView *pkt)
 {
 	uint pkt_set_size = MIN(pkt->getSet()->getSize(), TO_SIZE(m_protocol->m_config.get(ConfigItem::MAX_ADDR_CLAIM)));
 	//mirar si el pkt es aceptable o no
@@ -144,8 +143,9 @@ void DiscoveryState::storeOffer(Packet *pkt)
 									&& m_offer->getLifetime() < pkt->getLifetime())))
 	{
 	//tamaño del set, si es multicast o no el de config y el del offer, si lleva clientAddr y lo necesito y si el lftimer/set es mayor que el del offer que ya tengo en m_offer
-		delete m_offer;
-		m_offer = new Packet(pkt);
+		memcpy(m_offer_buf, pkt->getData(), pkt->getFrameLen());
+		m_offer_view.parse(m_offer_buf, pkt->getFrameLen());
+		m_offer = &m_offer_view;
 	}
 	return;
 }
@@ -247,13 +247,13 @@ void RequestingState::sendRequest()
 	m_protocol->m_event_loop.startTimer(&m_request_timer, REQUESTING_TIMEOUT);
 }
 
-void RequestingState::handlePacket(Packet *pkt)
+void RequestingState::handlePacket(PacketView *pkt)
 {
 	if(pkt->getType() == MsgType::ACK &&
 			pkt->getDA() == m_src_addr &&
 			pkt->getSA() == m_server_addr &&
 			pkt->getToken() == m_protocol->getToken() && 
-			m_protocol->checkStationId(pkt->getStationId())) 
+			m_protocol->checkStationId(pkt->getStationId(), pkt->getStationIdLen())) 
 	{
 		uint16_t lifetime = pkt->getLifetime();
 		if((pkt->getStatus() == StatusCode::ASSIGN_OK 
@@ -319,6 +319,7 @@ void DefendingState::start(AddrSet *set)
 			m_protocol->m_assigned_set.getSize());
 	m_protocol->m_event_loop.startTimer(&m_lease_lifetime_timer,SELF_ASSIGMENT_LIFETIME);	
 	sendAnnounce();
+	m_protocol->onAssigned();
 }
 
 void DefendingState::clean()
@@ -344,18 +345,18 @@ void DefendingState::sendAnnounce()
 	m_protocol->m_event_loop.startTimer(&m_announcement_timer, ANNOUNCE_TIMEOUT);
 }
 
-void DefendingState::sendDefend(AddrSet* original_set, AddrSet *conflict_set, uint64_t DA, uint8_t *station_id)
+void DefendingState::sendDefend(AddrSet* original_set, AddrSet *conflict_set, uint64_t DA, uint8_t *station_id, uint8_t station_id_len)
 {
 	Packet pkt(MsgType::DEFEND, DA, m_protocol->m_src_addr, m_protocol->getToken());
 	if(station_id != NULL)
-		pkt.addIdPar(ParType::STATION_ID, station_id);
+		pkt.addIdPar(ParType::STATION_ID, station_id, station_id_len);
 	pkt.addLifetimePar((uint16_t)(m_protocol->m_event_loop.readTimer(&m_lease_lifetime_timer) + 0.5));
 	pkt.addMacSetPar(original_set);
 	pkt.addMacSetPar(conflict_set, false);
 	m_protocol->m_netitf.netsend(&pkt);
 }
 
-void DefendingState::handlePacket(Packet *pkt)
+void DefendingState::handlePacket(PacketView *pkt)
 {
 	AddrSet conflict_set;	
 	if(pkt->getDA() == PALMA_MCAST)
@@ -364,16 +365,16 @@ void DefendingState::handlePacket(Packet *pkt)
 		{
 			m_protocol->m_db.exclude(pkt->getSet(), pkt->getLifetime());
 			if(conflict_set.checkConflict(pkt->getSet(),&m_protocol->m_assigned_set))
-				processConflict(pkt->getSet(), &conflict_set, pkt->getSA(), pkt->getStationId());
+				processConflict(pkt->getSet(), &conflict_set, pkt->getSA(), pkt->getStationId(), pkt->getStationIdLen());
 		}
 		else if(pkt->getType() == MsgType::DISCOVER && 
 				conflict_set.checkConflict(pkt->getSet(), &m_protocol->m_assigned_set))
 		{	
-			sendDefend(pkt->getSet(), &conflict_set, pkt->getSA(), pkt->getStationId());
+			sendDefend(pkt->getSet(), &conflict_set, pkt->getSA(), pkt->getStationId(), pkt->getStationIdLen());
 		}
 	}
 	else if(pkt->getDA() == m_protocol->m_src_addr &&
-			m_protocol->checkStationId(pkt->getStationId()))
+			m_protocol->checkStationId(pkt->getStationId(), pkt->getStationIdLen()))
 	{
 		if(pkt->getType() == MsgType::DEFEND)
 		{
@@ -405,7 +406,7 @@ void DefendingState::handlePacket(Packet *pkt)
 	}
 }
 
-void DefendingState::processConflict(AddrSet *original_set, AddrSet *conflict_set, uint64_t DA, uint8_t *station_id)
+void DefendingState::processConflict(AddrSet *original_set, AddrSet *conflict_set, uint64_t DA, uint8_t *station_id, uint8_t station_id_len)
 {
 	
 	//solidario
@@ -421,7 +422,7 @@ void DefendingState::processConflict(AddrSet *original_set, AddrSet *conflict_se
 	{
 		adjustSet(&m_protocol->m_assigned_set, min_assigned);
 		conflict_set->checkConflict(original_set, &m_protocol->m_assigned_set);
-		sendDefend(original_set, conflict_set, DA, station_id);
+		sendDefend(original_set, conflict_set, DA, station_id, station_id_len);
 	}
 	else
 	{ 
@@ -455,6 +456,7 @@ void BoundState::start(uint16_t lifetime, bool acceptable)
 		if(TO_BOOL(m_protocol->m_config.get(ConfigItem::RENEWAL)) && lifetime > 1)
 			lifetime -= 1;
 		m_protocol->m_event_loop.startTimer(&m_lease_lifetime_timer, (double) lifetime);
+		m_protocol->onAssigned();
 	}
 	else
 		sendRelease();
@@ -14,10 +14,10 @@ public:
 
 	State(PalmaClient *protocol);
 
-	virtual void handlePacket(Packet *pkt) {}
+	virtual void handlePacket(PacketView *pkt) {}
 	virtual void clean() {}
-	bool validSet(Packet *pkt);
-	bool validOffer(Packet *pkt);
+	bool validSet(PacketView *pkt);
+	bool validOffer(PacketView *pkt);
 };
 
 class DiscoveryState : public State
@@ -33,7 +33,9 @@ public:
 	DiscoveryTimer m_discovery_timer;
 	int m_dsc_count; 
 	uint64_t m_src_addr;
-	Packet *m_offer;
+	PacketView *m_offer;
+	PacketView m_offer_view;
+	uint8_t m_offer_buf[MAX_PKT_SIZE];
 	AddrSet m_discovery_set;
 	bool m_change_discovery;
 
@@ -41,10 +43,10 @@ public:
 	void start();
 	void clean();
 	void sendDiscover();
-	void handlePacket(Packet *pkt);
+	void handlePacket(PacketView *pkt);
 	void checkSet(AddrSet *set, uint16_t lifetime);
 	uint64_t getSrcAddr();
-	void storeOffer(Packet *pkt);
+	void storeOffer(PacketView *pkt);
 };
 
 class RequestingState : public State
@@ -67,7 +69,7 @@ public:
 	void start(uint64_t server_addr, uint64_t src_addr, AddrSet *set, bool renewal = false);
 	void clean();
 	void sendRequest();
-	void handlePacket(Packet *pkt);
+	void handlePacket(PacketView *pkt);
 	bool checkNetworkId(uint8_t *rcv, uint8_t *snd);
 };
 
@@ -95,9 +97,9 @@ public:
 	void start(AddrSet *set);
 	void clean();
 	void sendAnnounce();
-	void sendDefend(AddrSet *original_set, AddrSet *conflict_set, uint64_t DA, uint8_t *station_id = NULL);
-	void handlePacket(Packet *pkt);
-	void processConflict(AddrSet* original_set, AddrSet *conflict_set, uint64_t DA, uint8_t *station_id = NULL);
+	void sendDefend(AddrSet *original_set, AddrSet *conflict_set, uint64_t DA, uint8_t *station_id = NULL, uint8_t station_id_len = 0);
+	void handlePacket(PacketView *pkt);
+	void processConflict(AddrSet* original_set, AddrSet *conflict_set, uint64_t DA, uint8_t *station_id = NULL, uint8_t station_id_len = 0);
 };
 
 class BoundState : public State
@@ -99,30 +99,23 @@ static void convertToMask(uint64_t &addr, uint64_t &val)
 
 static void convertToAddr(uint64_t &val)
 {
-	uint64_t aux = ~val;
-	uint64_t count = 1;
-	for (int i=0; i<64 && (aux & 1); i++)
-	{
-		aux >>= 1;
-		count <<= 1;
-	}
-	val = count;
+	val = val ? (uint64_t) 1 << __builtin_ctzll(val) : 0;
 }
 
+/* The largest aligned block inside the set is of the highest order that
+   fits in its size if the first aligned address leaves room for it, and
+   of the order below otherwise, which always fits. */
+
 uint64_t AddrSet::getAlignedMask()
 {
-	uint64_t mask, first, last, new_mask;
-	mask = 0xffffffffffffffff;
-	first = getFirstAddr();
-	last = getLastAddr();
-	while(first >= getFirstAddr() && last <= getLastAddr())
-	{
-		new_mask = mask;
-		mask <<= 1;
-		first = (first + ~mask) & mask;
-		last = first + ~mask;
-	}
-	return new_mask;
+	uint64_t first = getFirstAddr();
+	uint64_t count = getSize();
+	if(count == 0)
+		return 0xffffffffffffffff;
+	uint64_t size = (uint64_t) 1 << (63 - __builtin_clzll(count));
+	if(((0 - first) & (size - 1)) > count - size)
+		size >>= 1;
+	return ~(size - 1);
 }
 
 void AddrSet::alignToMask(SetType type)
@@ -0,0 +1,299 @@
+#include <string.h>
+#include <immintrin.h>
+#include "btree.h"
+#include "database.h"
+
+/*
+ * In-node search kernels. All of them count the keys not greater than addr
+ * among the m_count in use. The vector ones compare the whole line at once
+ * with pcmpgtq, which is signed, so both sides get their top bit flipped to
+ * keep the unsigned order; the lanes past m_count are masked out of the
+ * result. SSE2 has no 64-bit compare, so below SSE4.2 the scalar loop is
+ * used.
+ */
+
+static int slotScalar(const BTreeNode *node, uint64_t addr)
+{
+	int i = 0;
+	while(i < node->m_count && node->m_first[i] <= addr)
+		i++;
+	return i;
+}
+
+__attribute__((target("sse4.2")))
+static int slotSSE42(const BTreeNode *node, uint64_t addr)
+{
+	const __m128i sign = _mm_set1_epi64x(INT64_MIN);
+	__m128i a = _mm_xor_si128(_mm_set1_epi64x(addr), sign);
+	int gt = 0;
+	for(int i = 0; i < BTREE_ORDER; i += 2)
+	{
+		__m128i k = _mm_xor_si128(_mm_load_si128((const __m128i *) (node->m_first + i)), sign);
+		gt |= _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(k, a))) << i;
+	}
+	return node->m_count - __builtin_popcount(gt & ((1 << node->m_count) - 1));
+}
+
+__attribute__((target("avx2")))
+static int slotAVX2(const BTreeNode *node, uint64_t addr)
+{
+	const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+	__m256i a = _mm256_xor_si256(_mm256_set1_epi64x(addr), sign);
+	__m256i k0 = _mm256_xor_si256(_mm256_load_si256((const __m256i *) node->m_first), sign);
+	__m256i k1 = _mm256_xor_si256(_mm256_load_si256((const __m256i *) (node->m_first + 4)), sign);
+	int gt = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k0, a)))
+			| _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(k1, a))) << 4;
+	return node->m_count - __builtin_popcount(gt & ((1 << node->m_count) - 1));
+}
+
+static int slotResolve(const BTreeNode *node, uint64_t addr);
+
+static int (*slotKernel)(const BTreeNode *, uint64_t) = slotResolve;
+static int kernel = BTREE_KERNEL_SCALAR;
+
+static void selectKernel()
+{
+	if(!BTreeNode::setKernel(BTREE_KERNEL_AVX2))
+		BTreeNode::setKernel(BTREE_KERNEL_SCALAR);
+}
+
+/* The first search picks AVX2 when the CPU has it. The SSE4.2 kernel only
+   pays off when the nodes are cached, so it is not chosen by default. */
+
+static int slotResolve(const BTreeNode *node, uint64_t addr)
+{
+	selectKernel();
+	return slotKernel(node, addr);
+}
+
+bool BTreeNode::setKernel(int k)
+{
+	__builtin_cpu_init();
+	switch(k)
+	{
+		case BTREE_KERNEL_AVX2:
+			if(!__builtin_cpu_supports("avx2"))
+				return false;
+			slotKernel = slotAVX2;
+			break;
+		case BTREE_KERNEL_SSE42:
+			if(!__builtin_cpu_supports("sse4.2"))
+				return false;
+			slotKernel = slotSSE42;
+			break;
+		case BTREE_KERNEL_SCALAR:
+			slotKernel = slotScalar;
+			break;
+		default:
+			return false;
+	}
+	kernel = k;
+	return true;
+}
+
+int BTreeNode::getKernel()
+{
+	if(slotKernel == slotResolve)
+		selectKernel();
+	return kernel;
+}
+
+const char *BTreeNode::kernelName(int k)
+{
+	switch(k)
+	{
+		case BTREE_KERNEL_AVX2:
+			return "avx2";
+		case BTREE_KERNEL_SSE42:
+			return "sse4.2";
+		default:
+			return "scalar";
+	}
+}
+
+int BTreeNode::slot(uint64_t addr)
+{
+	return slotKernel(this, addr) - 1;
+}
+
+BTreeIndex::BTreeIndex() : m_root(NULL) {}
+
+void BTreeIndex::setHugePages(bool huge)
+{
+	m_pool.setHugePages(huge);
+}
+
+void BTreeIndex::destroy(BTreeNode *node)
+{
+	if(!node->m_leaf)
+	{
+		for(int i = 0; i < node->m_count; i++)
+			destroy((BTreeNode *) node->m_ptr[i]);
+	}
+	m_pool.destroy(node);
+}
+
+void BTreeIndex::init(AssignableSet *set)
+{
+	if(m_root != NULL)
+		destroy(m_root);
+	m_root = NULL;
+	insert(set);
+}
+
+AssignableSet *BTreeIndex::search(uint64_t addr)
+{
+	BTreeNode *node = m_root;
+	int i;
+
+	if(node == NULL)
+		return NULL;
+	while(!node->m_leaf)
+	{
+		if((i = node->slot(addr)) < 0)
+			return NULL;
+		node = (BTreeNode *) node->m_ptr[i];
+	}
+	i = node->slot(addr);
+	if(i < 0 || addr > node->m_last[i])
+		return NULL;
+	return (AssignableSet *) node->m_ptr[i];
+}
+
+/* Returns the new right sibling when the node had to be split. */
+
+BTreeNode *BTreeIndex::insert(BTreeNode *node, AssignableSet *set)
+{
+	uint64_t first = set->getFirstAddr();
+	uint64_t last = set->getLastAddr();
+	void *ptr = set;
+
+	if(!node->m_leaf)
+	{
+		int i = node->slot(first);
+		if(i < 0)
+		{
+			i = 0;
+			node->m_first[0] = first;
+		}
+		BTreeNode *child = insert((BTreeNode *) node->m_ptr[i], set);
+		if(child == NULL)
+			return NULL;
+		first = child->m_first[0];
+		last = 0;
+		ptr = child;
+	}
+
+	BTreeNode *split = NULL;
+	BTreeNode *target = node;
+	if(node->m_count == BTREE_ORDER)
+	{
+		/* Appending past the last key leaves the node full, so that sets
+		   created in address order pack the leaves. */
+		int half = (first > node->m_first[BTREE_ORDER - 1]) ? BTREE_ORDER - 1 : BTREE_ORDER / 2;
+		split = m_pool.create(node->m_leaf);
+		memcpy(split->m_first, node->m_first + half, (BTREE_ORDER - half) * sizeof(uint64_t));
+		memcpy(split->m_last, node->m_last + half, (BTREE_ORDER - half) * sizeof(uint64_t));
+		memcpy(split->m_ptr, node->m_ptr + half, (BTREE_ORDER - half) * sizeof(void *));
+		split->m_count = BTREE_ORDER - half;
+		node->m_count = half;
+		if(first >= split->m_first[0])
+			target = split;
+	}
+	int pos = target->slot(first) + 1;
+	int move = target->m_count - pos;
+	memmove(target->m_first + pos + 1, target->m_first + pos, move * sizeof(uint64_t));
+	memmove(target->m_last + pos + 1, target->m_last + pos, move * sizeof(uint64_t));
+	memmove(target->m_ptr + pos + 1, target->m_ptr + pos, move * sizeof(void *));
+	target->m_first[pos] = first;
+	target->m_last[pos] = last;
+	target->m_ptr[pos] = ptr;
+	target->m_count++;
+	return split;
+}
+
+void BTreeIndex::insert(AssignableSet *set)
+{
+	if(m_root == NULL)
+		m_root = m_pool.create(true);
+	BTreeNode *split = insert(m_root, set);
+	if(split != NULL)
+	{
+		BTreeNode *root = m_pool.create(false);
+		root->m_first[0] = m_root->m_first[0];
+		root->m_ptr[0] = m_root;
+		root->m_first[1] = split->m_first[0];
+		root->m_ptr[1] = split;
+		root->m_count = 2;
+		m_root = root;
+	}
+}
+
+/* Returns true when the node is left empty. Separators are refreshed on
+   the way back so that they always hold the lowest key of their child. */
+
+bool BTreeIndex::erase(BTreeNode *node, uint64_t first)
+{
+	int i = node->slot(first);
+	if(i < 0)
+		return false;
+	if(!node->m_leaf)
+	{
+		BTreeNode *child = (BTreeNode *) node->m_ptr[i];
+		if(!erase(child, first))
+		{
+			node->m_first[i] = child->m_first[0];
+			return false;
+		}
+		m_pool.destroy(child);
+	}
+	else if(node->m_first[i] != first)
+		return false;
+	int move = node->m_count - i - 1;
+	memmove(node->m_first + i, node->m_first + i + 1, move * sizeof(uint64_t));
+	memmove(node->m_last + i, node->m_last + i + 1, move * sizeof(uint64_t));
+	memmove(node->m_ptr + i, node->m_ptr + i + 1, move * sizeof(void *));
+	node->m_count--;
+	return node->m_count == 0;
+}
+
+void BTreeIndex::erase(uint64_t first)
+{
+	if(m_root == NULL)
+		return;
+	if(erase(m_root, first))
+	{
+		m_pool.destroy(m_root);
+		m_root = NULL;
+		return;
+	}
+	while(!m_root->m_leaf && m_root->m_count == 1)
+	{
+		BTreeNode *root = m_root;
+		m_root = (BTreeNode *) root->m_ptr[0];
+		m_pool.destroy(root);
+	}
+}
+
+void BTreeIndex::setLast(uint64_t first, uint64_t last)
+{
+	BTreeNode *node = m_root;
+	int i;
+
+	if(node == NULL)
+		return;
+	while(!node->m_leaf)
+	{
+		if((i = node->slot(first)) < 0)
+			return;
+		node = (BTreeNode *) node->m_ptr[i];
+	}
+	i = node->slot(first);
+	if(i >= 0 && node->m_first[i] == first)
+		node->m_last[i] = last;
+}
+
+uint64_t BTreeIndex::nodes()
+{
+	return m_pool.m_in_use;
+}
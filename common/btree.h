@@ -0,0 +1,66 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <stdint.h>
+#include "pool.h"
+
+#define BTREE_ORDER		8
+
+#define BTREE_KERNEL_SCALAR		0
+#define BTREE_KERNEL_SSE42		1
+#define BTREE_KERNEL_AVX2		2
+
+class AssignableSet;
+
+/*
+ * Node of the B+tree lookup index. Each array is one 64-byte line, so the
+ * keys compared while descending are read from a single cache line and
+ * the entry is only dereferenced once the slot is known. Inner nodes keep
+ * in m_first the lowest key of each child; leaves keep the first and last
+ * address of each set.
+ */
+
+struct alignas(64) BTreeNode
+{
+	uint64_t m_first[BTREE_ORDER];
+	uint64_t m_last[BTREE_ORDER];
+	void *m_ptr[BTREE_ORDER];
+	int m_count;
+	bool m_leaf;
+
+	BTreeNode(bool leaf) : m_count(0), m_leaf(leaf) {}
+	int slot(uint64_t addr);
+
+	static bool setKernel(int kernel);
+	static int getKernel();
+	static const char *kernelName(int kernel);
+};
+
+/*
+ * Address lookup index over the sets of a SetDatabase. It mirrors the
+ * intervals of the 2-3 tree, which remains the owner of the sets and
+ * answers the free space queries. Emptied nodes are released but
+ * underfull ones are not merged.
+ */
+
+class BTreeIndex
+{
+	ObjectPool<BTreeNode> m_pool;
+	BTreeNode *m_root;
+
+	BTreeNode *insert(BTreeNode *node, AssignableSet *set);
+	bool erase(BTreeNode *node, uint64_t first);
+	void destroy(BTreeNode *node);
+
+public:
+	BTreeIndex();
+	void setHugePages(bool huge);
+	void init(AssignableSet *set);
+	AssignableSet *search(uint64_t addr);
+	void insert(AssignableSet *set);
+	void erase(uint64_t first);
+	void setLast(uint64_t first, uint64_t last);
+	uint64_t nodes();
+};
+
+#endif
@@ -1,20 +1,41 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
 #include <math.h>
 #include "database.h"
+#include "policy.h"
 #include "palma.h"
 
 #define MIN(a,b) (a < b ? a : b)
 #define MAX(a,b) (a > b ? a : b)
 
+#define MIN_RESTORED_LIFETIME	0.001
+#define MIN_ID_BUCKETS			64
+#define RANDOM_TRIES			32
+#define EXPIRE_REBUILD			8
+
 AssignableSet::AssignableSet(uint64_t addr, uint64_t count) :
 										AddrSet(addr, count),
 										m_next_free(NULL),
-										m_ptr(NULL) {}
+										m_ptr(NULL),
+										m_id_next(NULL),
+										m_id_pprev(NULL) {}
 
 AssignableSet::AssignableSet(AddrSet* set) : AddrSet(set->getFirstAddr(), set->getSize()),
 											m_next_free(NULL),
-											m_ptr(NULL){}
+											m_ptr(NULL),
+											m_id_next(NULL),
+											m_id_pprev(NULL) {}
+
+uint64_t AssignableSet::getFreeSize()
+{
+	if(m_next_free == NULL)
+		return 0;
+	if(getSize() > 0xffff)
+		return MAX(getAlignedSize(), 0xffff);
+	return getSize();
+}
 	
 void AssignableSet::chain(AssignableSet *set)
 {
@@ -49,38 +70,47 @@ bool AssignableSet::unchain(void *db)
 	return last_set;	
 }
 
-void AssignableSet::timeout()
+void AssignableSet::reclaim()
 {
 	SetDatabase *db = (SetDatabase*) m_ptr;
+	db->unindexSet(this);
 	AssignableSet *prev_set = db->search(getFirstAddr() - 1);
 	AssignableSet *next_set = db->search(getLastAddr() + 1);
-	chain(db->m_free_list);
-	if(db->m_free_list == NULL)
-		db->m_free_list = this;
+	db->chainFree(this);
 	if(next_set != NULL && next_set->m_next_free != NULL)
 		db->joinAndDelete(this);
 	if(prev_set != NULL && prev_set->m_next_free != NULL)
-		db->joinAndDelete(prev_set);	
+		db->joinAndDelete(prev_set);
+	else
+		db->update(this);
 }
 
-TreeNode::TreeNode()
+void AssignableSet::timeout()
 {
+	SetDatabase *db = (SetDatabase*) m_ptr;
+	if(db->m_listener != NULL)
+		db->m_listener->onFree(db, this, true);
+	reclaim();
+}
+
+/* Leased sets point to their database, which expires them in batches. */
+
+TimerGroup *AssignableSet::group()
+{
+	return (SetDatabase*) m_ptr;
+}
+
+TreeNode::TreeNode(SetDatabase *db)
+{
+	m_db = db;
 	m_parent = NULL;
 	m_child[0] = NULL;
 	m_child[1] = NULL;
 	m_child[2] = NULL;
 	m_set[0] = NULL;
 	m_set[1] = NULL;
-}
-
-
-TreeNode::~TreeNode()
-{
-	delete(m_child[0]);
-	delete(m_child[1]);
-	delete(m_child[2]);
-	delete(m_set[0]);
-	delete(m_set[1]);
+	m_max_free = 0;
+	m_free_count = 0;
 }
 
 TreeNode *TreeNode::locate(uint64_t addr, int &index)
@@ -139,9 +169,10 @@ void TreeNode::add(AssignableSet *set, TreeNode *item)
 			setChild(2, item);
 		}
 		m_set[1] = set;
+		updatePath();
 		return;
 	}
-	TreeNode *sibling = new TreeNode();
+	TreeNode *sibling = m_db->m_node_pool.create(m_db);
 	if(set->getFirstAddr() < m_set[0]->getFirstAddr())
 	{
 		set = m_set[0];
@@ -172,17 +203,20 @@ void TreeNode::add(AssignableSet *set, TreeNode *item)
 	}
 	m_child[1] = NULL;
 	m_set[1] = NULL;	
+	update();
+	sibling->update();
 	if(m_parent != NULL)
 	{
 		m_parent->add(set, sibling);
 	}
 	else
 	{
-		TreeNode *parent = new TreeNode();
+		TreeNode *parent = m_db->m_node_pool.create(m_db);
 		parent->m_set[0] = set;
 		parent->m_child[0] = this;
 		parent->m_child[2] = sibling;
 		m_parent = sibling->m_parent = parent;
+		parent->update();
 	}	
 }
 
@@ -213,6 +247,9 @@ int TreeNode::redistribute_left(int index)
 		m_child[2] = m_child[0];
 		setChild(0, sibling->m_child[2]);
 		sibling->setChild(2, sibling->m_child[1]);
+		sibling->update();
+		update();
+		m_parent->updatePath();
 		return 1;
 	}
 	return 0;
@@ -233,6 +270,9 @@ int TreeNode::redistribute_right(int index)
 		sibling->m_set[1] = NULL;
 		setChild(2, sibling->m_child[0]);
 		sibling->setChild(0, sibling->m_child[1]);
+		sibling->update();
+		update();
+		m_parent->updatePath();
 		return 1;
 	}
 	return 0;
@@ -240,7 +280,8 @@ int TreeNode::redistribute_right(int index)
 
 int TreeNode::redistribute_up(int index)
 {
-	if(m_parent->m_set[1] != NULL)
+	TreeNode *parent = m_parent;
+	if(parent->m_set[1] != NULL)
 	{
 		switch(index)
 		{
@@ -265,19 +306,27 @@ int TreeNode::redistribute_up(int index)
 				setChild(0, m_parent->m_child[1]->m_child[0]);
 				break;
 		}
+		if(index == 1)
+			m_parent->m_child[0]->update();
+		else
+			update();
 		m_parent->m_child[1]->m_set[0] = NULL;
 		m_parent->m_child[1]->m_child[0] = m_parent->m_child[1]->m_child[2] = NULL;
 		m_parent->m_set[1] = NULL;
 		TreeNode *item = m_parent->m_child[1];
 		m_parent->m_child[1] = NULL;
-		delete item;
+		m_db->m_node_pool.destroy(item);
+		parent->updatePath();
 		return 1;
 	}
 	return 0;
 }
 
+/* merge() and del() may release this node, so the database is read first. */
+
 TreeNode *TreeNode::merge(int index)
 {
+	SetDatabase *db = m_db;
 	TreeNode *parent = m_parent;
 	if(index == 0)
 	{
@@ -294,7 +343,8 @@ TreeNode *TreeNode::merge(int index)
 		parent->m_child[0]->setChild(2, m_child[0]);
 		m_set[0] = NULL;
 	}
-	delete parent->m_child[2];
+	parent->m_child[0]->update();
+	db->m_node_pool.destroy(parent->m_child[2]);
 	parent->m_set[0] = NULL;
 	parent->m_child[2] = NULL;
 	if(parent->m_parent != NULL)
@@ -302,7 +352,7 @@ TreeNode *TreeNode::merge(int index)
 	TreeNode *new_root = parent->m_child[0];
 	new_root->m_parent = NULL;
 	parent->m_child[0] = NULL;
-	delete parent;
+	db->m_node_pool.destroy(parent);
 	return new_root;	
 }
 
@@ -318,6 +368,7 @@ TreeNode *TreeNode::redistribute()
 
 TreeNode *TreeNode::del(int index)
 {
+	SetDatabase *db = m_db;
 	AssignableSet *set = m_set[index];
 	TreeNode *new_root = NULL;
 	if(m_child[0] != NULL) //search inorder successor
@@ -332,53 +383,553 @@ TreeNode *TreeNode::del(int index)
 	{
 		m_set[index] = m_set[1-index];
 		m_set[1] = NULL;
+		updatePath();
 	}
 	else
 	{
 		new_root = redistribute();
 		
 	}
-	delete set;
+	db->m_set_pool.destroy(set);
 	return new_root; 
 }
 
+void TreeNode::update()
+{
+	uint64_t size;
+	m_max_free = 0;
+	m_free_count = 0;
+	for(int i=0; i<2; i++)
+	{
+		if(m_set[i] != NULL && (size = m_set[i]->getFreeSize()) > m_max_free)
+			m_max_free = size;
+		if(m_set[i] != NULL && m_set[i]->m_next_free != NULL)
+			m_free_count += m_set[i]->getSize();
+	}
+	for(int i=0; i<3; i++)
+	{
+		if(m_child[i] != NULL && m_child[i]->m_max_free > m_max_free)
+			m_max_free = m_child[i]->m_max_free;
+		if(m_child[i] != NULL)
+			m_free_count += m_child[i]->m_free_count;
+	}
+}
+
+void TreeNode::updatePath()
+{
+	for(TreeNode *node = this; node != NULL; node = node->m_parent)
+		node->update();
+}
+
+AssignableSet *TreeNode::findFree(uint64_t size)
+{
+	for(int i=0; i<3; i++)
+	{
+		if(m_child[i] != NULL && m_child[i]->m_max_free >= size)
+			return m_child[i]->findFree(size);
+		if(i < 2 && m_set[i] != NULL && m_set[i]->getFreeSize() >= size)
+			return m_set[i];
+	}
+	return NULL;
+}
+
+/* Free set holding the free address found at the given offset when the
+   free addresses of the subtree are counted in order. */
+
+AssignableSet *TreeNode::findFreeAt(uint64_t offset)
+{
+	for(int i=0; i<3; i++)
+	{
+		if(m_child[i] != NULL)
+		{
+			if(offset < m_child[i]->m_free_count)
+				return m_child[i]->findFreeAt(offset);
+			offset -= m_child[i]->m_free_count;
+		}
+		if(i < 2 && m_set[i] != NULL && m_set[i]->m_next_free != NULL)
+		{
+			if(offset < m_set[i]->getSize())
+				return m_set[i];
+			offset -= m_set[i]->getSize();
+		}
+	}
+	return NULL;
+}
+
+/* Subtrees without a set that fits are skipped, but all the others have
+   to be walked, so a pick can visit every free set. */
+
+AssignableSet *TreeNode::findBest(uint64_t size, AssignableSet *best)
+{
+	uint64_t free_size;
+	for(int i=0; i<3; i++)
+	{
+		if(best != NULL && best->getFreeSize() == size)
+			break;
+		if(m_child[i] != NULL && m_child[i]->m_max_free >= size)
+			best = m_child[i]->findBest(size, best);
+		if(i < 2 && m_set[i] != NULL && (free_size = m_set[i]->getFreeSize()) >= size
+			&& (best == NULL || free_size < best->getFreeSize()))
+			best = m_set[i];
+	}
+	return best;
+}
+
+/* First free set that fits starting at addr or above. The subtrees below
+   a set starting at addr or before lie wholly under it. */
+
+AssignableSet *TreeNode::findFreeFrom(uint64_t addr, uint64_t size)
+{
+	AssignableSet *set;
+	for(int i=0; i<3; i++)
+	{
+		if(m_child[i] != NULL && m_child[i]->m_max_free >= size
+			&& (i == 2 || m_set[i]->getFirstAddr() > addr)
+			&& (set = m_child[i]->findFreeFrom(addr, size)) != NULL)
+			return set;
+		if(i < 2 && m_set[i] != NULL && m_set[i]->getFirstAddr() >= addr && m_set[i]->getFreeSize() >= size)
+			return m_set[i];
+	}
+	return NULL;
+}
+
+/* First free set holding an aligned block of the given size. No set
+   smaller than the block can hold it, which prunes the walk. */
+
+AssignableSet *TreeNode::findAligned(uint64_t block)
+{
+	AssignableSet *set;
+	for(int i=0; i<3; i++)
+	{
+		if(m_child[i] != NULL && m_child[i]->m_max_free >= block
+			&& (set = m_child[i]->findAligned(block)) != NULL)
+			return set;
+		if(i < 2 && m_set[i] != NULL && m_set[i]->m_next_free != NULL && m_set[i]->getAlignedSize() >= block)
+			return m_set[i];
+	}
+	return NULL;
+}
+
 
 SetDatabase::SetDatabase(Palma *protocol) : m_protocol(protocol),
-													m_total_set(){}
+													m_root(NULL),
+													m_total_set(),
+													m_use_btree(false),
+													m_listener(NULL),
+													m_id_table(NULL),
+													m_id_size(0),
+													m_id_count(0),
+													m_expire_bursts(0),
+													m_expired(0),
+													m_expire_rebuilds(0),
+													m_expire_time(0),
+													m_expire_max(0),
+													m_order_map(0),
+													m_buddy(false),
+													m_policy(NULL)
+{
+	memset(m_order_list, 0, sizeof(m_order_list));
+}
+
+/* The lease timers are stopped, since the event loop may share its timers
+   with loops that outlive the database. */
+
+SetDatabase::~SetDatabase()
+{
+	clear(m_root);
+	free(m_id_table);
+	delete m_policy;
+}
+
+void SetDatabase::setHugePages(bool huge)
+{
+	m_node_pool.setHugePages(huge);
+	m_set_pool.setHugePages(huge);
+	m_btree.setHugePages(huge);
+}
+
+/* Both must be chosen before init(). */
+
+void SetDatabase::setBTreeIndex(bool enabled)
+{
+	m_use_btree = enabled;
+}
+
+void SetDatabase::setBuddy(bool enabled)
+{
+	m_buddy = enabled;
+}
+
+/* NULL keeps the default first-fit pick. The database owns the policy
+   from then on. */
+
+void SetDatabase::setPolicy(AllocPolicy *policy)
+{
+	delete m_policy;
+	m_policy = policy;
+}
+
+void SetDatabase::setListener(LeaseListener *listener)
+{
+	m_listener = listener;
+}
 
 void SetDatabase::init(AddrSet *set) 
 {
 	m_total_set = *set;
-	m_root = new TreeNode();
-	m_root->m_set[0] = new AssignableSet(set);
-	m_root->m_set[0]->m_next_free = m_root->m_set[0];
-	m_root->m_set[0]->m_ptr = m_root->m_set[0];
-	m_free_list = m_root->m_set[0];
+	if(m_id_table != NULL)
+		memset(m_id_table, 0, m_id_size * sizeof(AssignableSet *));
+	m_id_count = 0;
+	m_root = m_node_pool.create(this);
+	m_root->m_set[0] = m_set_pool.create(set);
+	m_free_list = NULL;
+	memset(m_order_list, 0, sizeof(m_order_list));
+	m_order_map = 0;
+	chainFree(m_root->m_set[0]);
+	m_root->update();
+	if(m_use_btree)
+		m_btree.init(m_root->m_set[0]);
 }
 
-SetDatabase::~SetDatabase()
+/* Builds the database from a list of intervals sorted by address, in
+   O(n) instead of init() and one extract() per lease: the sets are
+   created in order, the tree is built bottom-up, the free list chained
+   and all the lease timers started at once. Fails, leaving the database
+   untouched, if the intervals overlap or fall outside the set. */
+
+bool SetDatabase::load(AddrSet *set, LeaseEntry *entries, uint64_t n)
 {
-	delete(m_root);
+	uint64_t next = set->getFirstAddr();
+	uint64_t leases = 0;
+	for(uint64_t i = 0; i < n; i++)
+	{
+		LeaseEntry *e = &entries[i];
+		if(e->m_count == 0 || e->m_first < next || e->m_first > set->getLastAddr()
+			|| e->m_count - 1 > set->getLastAddr() - e->m_first
+			|| (e->m_status != DbStatus::FREE && e->m_status != DbStatus::RESERVED && e->m_status != DbStatus::ASSIGNED))
+			return false;
+		next = e->m_first + e->m_count;
+		if(e->m_status != DbStatus::FREE)
+			leases++;
+	}
+
+	AssignableSet **sets = (AssignableSet **) malloc((2 * leases + 1) * sizeof(AssignableSet *));
+	Timer **timers = (Timer **) malloc((leases + 1) * sizeof(Timer *));
+	if(sets == NULL || timers == NULL)
+	{
+		perror("Loading set database");
+		exit(1);
+	}
+	clear(m_root);
+	if(m_id_table != NULL)
+		memset(m_id_table, 0, m_id_size * sizeof(AssignableSet *));
+	m_id_count = 0;
+	m_total_set = *set;
+	m_free_list = NULL;
+	memset(m_order_list, 0, sizeof(m_order_list));
+	m_order_map = 0;
+	uint64_t count = 0;
+	leases = 0;
+	next = set->getFirstAddr();
+	for(uint64_t i = 0; i <= n; i++)
+	{
+		if(i < n && entries[i].m_status == DbStatus::FREE)
+			continue;
+		uint64_t end = (i < n) ? entries[i].m_first : set->getLastAddr() + 1;
+		if(end != next)
+		{
+			AssignableSet *gap = m_set_pool.create(next, end - next);
+			chainFree(gap);
+			sets[count++] = gap;
+		}
+		if(i == n)
+			break;
+		LeaseEntry *e = &entries[i];
+		AssignableSet *lease = m_set_pool.create(e->m_first, e->m_count);
+		lease->m_ptr = this;
+		lease->m_security_id = e->m_security_id;
+		lease->m_reserved = (e->m_status == DbStatus::RESERVED);
+		lease->set(MAX(e->m_lifetime, MIN_RESTORED_LIFETIME));
+		indexSet(lease);
+		sets[count++] = lease;
+		timers[leases++] = lease;
+		next = e->m_first + e->m_count;
+	}
+
+	rebuild(sets, count);
+	m_protocol->m_event_loop.startTimers(timers, leases);
+	free(sets);
+	free(timers);
+	return true;
+}
+
+/* Balanced subtree with all its leaves at the given height. A subtree of
+   height h holds between 2^(h+1)-1 and 3^(h+1)-1 sets, and n must be in
+   that range. */
+
+TreeNode *SetDatabase::buildTree(AssignableSet **sets, uint64_t n, int height)
+{
+	TreeNode *node = m_node_pool.create(this);
+	if(height == 0)
+	{
+		node->m_set[0] = sets[0];
+		if(n == 2)
+			node->m_set[1] = sets[1];
+		node->update();
+		return node;
+	}
+	uint64_t child_cap = 2;
+	for(int h = 1; h < height; h++)
+		child_cap = 3 * child_cap + 2;
+	int k = (n - 1 <= 2 * child_cap) ? 2 : 3;
+	uint64_t rest = n - (k - 1);
+	for(int c = 0; c < k; c++)
+	{
+		uint64_t size = rest / k + ((uint64_t) c < rest % k ? 1 : 0);
+		TreeNode *child = buildTree(sets, size, height - 1);
+		node->setChild((k == 2 && c == 1) ? 2 : c, child);
+		sets += size;
+		if(c < k - 1)
+			node->m_set[c] = *sets++;
+	}
+	node->update();
+	return node;
+}
+
+/* Replaces the tree, and the B-tree index, with new ones holding the n
+   sets given in address order. */
+
+void SetDatabase::rebuild(AssignableSet **sets, uint64_t n)
+{
+	int height = 0;
+	for(uint64_t cap = 2; cap < n; cap = 3 * cap + 2)
+		height++;
+	m_root = buildTree(sets, n, height);
+	if(m_use_btree)
+	{
+		m_btree.init(sets[0]);
+		for(uint64_t i = 1; i < n; i++)
+			m_btree.insert(sets[i]);
+	}
+}
+
+void SetDatabase::clear(TreeNode *node)
+{
+	if(node == NULL)
+		return;
+	for(int i = 0; i < 3; i++)
+		clear(node->m_child[i]);
+	for(int i = 0; i < 2; i++)
+	{
+		if(node->m_set[i] != NULL)
+		{
+			m_protocol->m_event_loop.stopTimer(node->m_set[i]);
+			m_set_pool.destroy(node->m_set[i]);
+		}
+	}
+	m_node_pool.destroy(node);
+}
+
+/* Appends the sets of the subtree in address order, destroying its nodes
+   but not the sets. */
+
+void SetDatabase::collect(TreeNode *node, AssignableSet **sets, uint64_t &n)
+{
+	if(node == NULL)
+		return;
+	for(int i = 0; i < 3; i++)
+	{
+		collect(node->m_child[i], sets, n);
+		if(i < 2 && node->m_set[i] != NULL)
+			sets[n++] = node->m_set[i];
+	}
+	m_node_pool.destroy(node);
 }
 
 AssignableSet *SetDatabase::search(uint64_t addr)
 {
 	int index;
+	if(m_use_btree)
+		return m_btree.search(addr);
 	return m_root->locate(addr, index)->getSet(index);
 }
 
+/*
+ * Leases are also hashed by security id, chained through the sets
+ * themselves, so that those of a client can be found without knowing
+ * their addresses. Security ids are SipHash digests, so their low bits
+ * are used directly as the bucket. Several leases may share an id (a
+ * set and the client address assigned with it).
+ */
+
+void SetDatabase::indexSet(AssignableSet *set)
+{
+	if(m_id_count >= m_id_size)
+		growIndex();
+	AssignableSet **head = &m_id_table[set->m_security_id & (m_id_size - 1)];
+	set->m_id_next = *head;
+	if(*head != NULL)
+		(*head)->m_id_pprev = &set->m_id_next;
+	*head = set;
+	set->m_id_pprev = head;
+	m_id_count++;
+}
+
+void SetDatabase::unindexSet(AssignableSet *set)
+{
+	if(set->m_id_pprev == NULL)
+		return;
+	*set->m_id_pprev = set->m_id_next;
+	if(set->m_id_next != NULL)
+		set->m_id_next->m_id_pprev = set->m_id_pprev;
+	set->m_id_next = NULL;
+	set->m_id_pprev = NULL;
+	m_id_count--;
+}
+
+void SetDatabase::growIndex()
+{
+	uint64_t size = m_id_size ? 2 * m_id_size : MIN_ID_BUCKETS;
+	AssignableSet **table = (AssignableSet **) calloc(size, sizeof(AssignableSet *));
+	if(table == NULL)
+	{
+		perror("Growing security id index");
+		exit(1);
+	}
+	for(uint64_t i = 0; i < m_id_size; i++)
+	{
+		AssignableSet *p = m_id_table[i];
+		while(p != NULL)
+		{
+			AssignableSet *next = p->m_id_next;
+			AssignableSet **head = &table[p->m_security_id & (size - 1)];
+			p->m_id_next = *head;
+			if(*head != NULL)
+				(*head)->m_id_pprev = &p->m_id_next;
+			*head = p;
+			p->m_id_pprev = head;
+			p = next;
+		}
+	}
+	free(m_id_table);
+	m_id_table = table;
+	m_id_size = size;
+}
+
+/* Lease with the given security id containing the set, or any of them if
+   no set is given. */
+
+AssignableSet *SetDatabase::findLease(uint64_t security_id, AddrSet *set)
+{
+	if(m_id_table == NULL)
+		return NULL;
+	for(AssignableSet *p = m_id_table[security_id & (m_id_size - 1)]; p != NULL; p = p->m_id_next)
+	{
+		if(p->m_security_id == security_id && (set == NULL
+			|| (set->getFirstAddr() >= p->getFirstAddr() && set->getLastAddr() <= p->getLastAddr())))
+			return p;
+	}
+	return NULL;
+}
+
+static inline int blockOrder(uint64_t size)
+{
+	return 63 - __builtin_clzll(size);
+}
+
+/*
+ * Free sets are chained in m_free_list or, in buddy mode, in per-order
+ * lists: a free set is listed under the order of the largest aligned
+ * block it holds, and m_order_map has a bit set for each list that is not
+ * empty. Free neighbours are merged as in the default mode, which also
+ * merges any two free buddies.
+ */
+
+int SetDatabase::freeOrder(AssignableSet *set)
+{
+	return blockOrder(set->getAlignedSize());
+}
+
+void SetDatabase::chainFree(AssignableSet *set)
+{
+	AssignableSet **list = &m_free_list;
+	if(m_buddy)
+	{
+		int order = freeOrder(set);
+		list = &m_order_list[order];
+		m_order_map |= (uint64_t) 1 << order;
+	}
+	set->chain(*list);
+	if(*list == NULL)
+		*list = set;
+}
+
+void SetDatabase::unchainFree(AssignableSet *set, void *ptr)
+{
+	int order = 0;
+	AssignableSet **list = &m_free_list;
+	if(m_buddy)
+	{
+		order = freeOrder(set);
+		list = &m_order_list[order];
+	}
+	if(*list == set)
+		*list = set->m_next_free;
+	if(set->unchain(ptr))
+	{
+		*list = NULL;
+		m_order_map &= ~((uint64_t) 1 << order);
+	}
+}
+
+/* Sets of more than 0xffff addresses can only be given as an aligned
+   block, so those requests are rounded down to a power of 2 and the block
+   taken from the free set of the lowest order that holds one, or of the
+   largest order if none does, so that the larger blocks are left whole. */
+
+AssignableSet *SetDatabase::buddyFind(uint64_t count)
+{
+	if(m_order_map == 0)
+		return NULL;
+	int order = blockOrder(count);
+	uint64_t fits = m_order_map & (~(uint64_t) 0 << order);
+	AssignableSet *free_set = m_order_list[fits ? __builtin_ctzll(fits) : blockOrder(m_order_map)];
+	AddrSet set = *free_set;
+	set.alignToMask(SetType::ADDR);
+	if(set.getSize() > ((uint64_t) 1 << order))
+		set.setSize((uint64_t) 1 << order);
+	extract(free_set, &set);
+	return free_set;
+}
+
 AssignableSet* SetDatabase::splitAndInsert(AssignableSet* set, uint64_t size)
 {
 	if(set->getSize() <= size)
 		return NULL;
 	AssignableSet *new_set = 
-			new AssignableSet(set->getFirstAddr() + set->getSize() - size, size);
-	set->setSize(set->getSize() - size);
-	new_set->chain(set);
+			m_set_pool.create(set->getFirstAddr() + set->getSize() - size, size);
+	if(m_buddy)
+	{
+		unchainFree(set, NULL);
+		set->setSize(set->getSize() - size);
+		chainFree(set);
+		chainFree(new_set);
+	}
+	else
+	{
+		set->setSize(set->getSize() - size);
+		new_set->chain(set);
+	}
 	int idx;
 	m_root->locate(new_set->getFirstAddr(), idx)->add(new_set, NULL);
 	if(m_root->m_parent)
 		m_root = m_root->m_parent;
+	update(set);
+	if(m_use_btree)
+	{
+		m_btree.setLast(set->getFirstAddr(), set->getLastAddr());
+		m_btree.insert(new_set);
+	}
 	return new_set;
 }
 
@@ -388,18 +939,135 @@ void SetDatabase::joinAndDelete(AssignableSet *set)
 	TreeNode *node = m_root->locate(set->getLastAddr() + 1, index);
 	AssignableSet *next = node->getSet(index);
 	if(next->m_next_free == NULL)
-		m_protocol->m_event_loop.stopTimer(next);
-	else
 	{
-		next->unchain(NULL);
-		if(m_free_list == next)
-			m_free_list = set;
+		m_protocol->m_event_loop.stopTimer(next);
+		unindexSet(next);
 	}
+	else
+		unchainFree(next, NULL);
 	
+	if(m_use_btree)
+		m_btree.erase(next->getFirstAddr());
+	bool listed = m_buddy && set->m_next_free != NULL;
+	if(listed)
+		unchainFree(set, NULL);
 	set->setSize(set->getSize() + next->getSize());
+	if(listed)
+		chainFree(set);
 	TreeNode *new_root = node->del(index);
 	if(new_root != NULL)
 		m_root = new_root;
+	update(set);
+	if(m_use_btree)
+		m_btree.setLast(set->getFirstAddr(), set->getLastAddr());
+}
+
+static int compareSets(const void *a, const void *b)
+{
+	uint64_t x = (*(AssignableSet * const *) a)->getFirstAddr();
+	uint64_t y = (*(AssignableSet * const *) b)->getFirstAddr();
+	return (x > y) - (x < y);
+}
+
+/* Leases found expired in the same check of the timers. They are sorted
+   by address, so that each run of adjacent leases is joined into one set
+   before it is merged with its free neighbours. A burst large compared to
+   the database rebuilds the tree in one in-order pass instead. */
+
+void SetDatabase::expire(Timer **timers, int n)
+{
+	Time start;
+	AssignableSet **sets = (AssignableSet **) malloc(n * sizeof(AssignableSet *));
+	if(sets == NULL)
+	{
+		perror("Expiring leases");
+		exit(1);
+	}
+	for(int i = 0; i < n; i++)
+		sets[i] = (AssignableSet *) timers[i];
+	qsort(sets, n, sizeof(AssignableSet *), compareSets);
+	if(m_listener != NULL)
+	{
+		for(int i = 0; i < n; i++)
+			m_listener->onFree(this, sets[i], true);
+	}
+	if((uint64_t) n * EXPIRE_REBUILD >= m_set_pool.m_in_use)
+		expireRebuild(sets, n);
+	else
+		expireRuns(sets, n);
+	free(sets);
+
+	double elapsed = Time().elapsed(start);
+	m_expire_bursts++;
+	m_expired += n;
+	m_expire_time += elapsed;
+	if(elapsed > m_expire_max)
+		m_expire_max = elapsed;
+}
+
+void SetDatabase::expireRuns(AssignableSet **sets, int n)
+{
+	for(int i = 0; i < n; )
+	{
+		AssignableSet *set = sets[i++];
+		while(i < n && sets[i]->getFirstAddr() == set->getLastAddr() + 1)
+		{
+			joinAndDelete(set);
+			i++;
+		}
+		set->reclaim();
+	}
+}
+
+/* The expired leases and the free sets around them are merged while the
+   sets are taken out of the old tree, and the free lists chained again. */
+
+void SetDatabase::expireRebuild(AssignableSet **sets, int n)
+{
+	AssignableSet **all = (AssignableSet **) malloc(m_set_pool.m_in_use * sizeof(AssignableSet *));
+	if(all == NULL)
+	{
+		perror("Expiring leases");
+		exit(1);
+	}
+	uint64_t count = 0, kept = 0;
+	collect(m_root, all, count);
+	for(uint64_t i = 0, j = 0; i < count; i++)
+	{
+		AssignableSet *set = all[i];
+		if(j < (uint64_t) n && sets[j] == set)
+		{
+			j++;
+			unindexSet(set);
+			set->m_next_free = set;
+		}
+		if(set->m_next_free == NULL)
+			all[kept++] = set;
+		else if(kept > 0 && all[kept - 1]->m_next_free != NULL)
+		{
+			all[kept - 1]->setSize(all[kept - 1]->getSize() + set->getSize());
+			m_set_pool.destroy(set);
+		}
+		else
+			all[kept++] = set;
+	}
+	m_free_list = NULL;
+	memset(m_order_list, 0, sizeof(m_order_list));
+	m_order_map = 0;
+	for(uint64_t i = 0; i < kept; i++)
+	{
+		if(all[i]->m_next_free != NULL)
+			chainFree(all[i]);
+	}
+	rebuild(all, kept);
+	m_expire_rebuilds++;
+	free(all);
+}
+
+void SetDatabase::update(AssignableSet *set)
+{
+	int index;
+	m_root->locate(set->getFirstAddr(), index)->updatePath();
 }
 
 int SetDatabase::exclude(AddrSet *recv_set, uint16_t lifetime)
@@ -419,53 +1087,60 @@ int SetDatabase::exclude(AddrSet *recv_set, uint16_t lifetime)
 				{
 					m_protocol->m_event_loop.stopTimer(r);
 					m_protocol->m_event_loop.startTimer(r, lifetime);
+					if(m_listener != NULL)
+						m_listener->onLease(this, r, lifetime);
 				}
 				return 0;
 			}
 			else
 			{
 				m_protocol->m_event_loop.stopTimer(r);
-				r->chain(m_free_list);
-				if(m_free_list == NULL)
-					m_free_list = r;
+				if(m_listener != NULL)
+					m_listener->onFree(this, r, false);
+				unindexSet(r);
+				chainFree(r);
 			}		
 		}
 		while(r->getLastAddr() < set.getLastAddr())
 		{
+			/* The leases joined into the range are given up. */
+			if(m_listener != NULL)
+			{
+				AssignableSet *next = search(r->getLastAddr() + 1);
+				if(next->m_next_free == NULL)
+					m_listener->onFree(this, next, false);
+			}
 			joinAndDelete(r);
 		}
 		extract(r, &set);
 		m_protocol->m_event_loop.startTimer(r, lifetime);
+		if(m_listener != NULL)
+			m_listener->onLease(this, r, lifetime);
 		return 0;
 	}
 	return -1;
 }
 
+/* The random pick draws a free address uniformly, so that each free set
+   large enough is chosen with a chance proportional to its size. Draws
+   landing in smaller sets are repeated, up to RANDOM_TRIES times before
+   falling back to the first set that fits. */
+
 AssignableSet* SetDatabase::getFreeSet(uint64_t min, uint64_t max, bool random)
 {
-	AssignableSet *p = m_free_list;
-	AssignableSet *best;
-	uint64_t best_size = 0, size;
-	if(p == NULL)
+	uint64_t size = MIN(m_root->m_max_free, max);
+	if(size == 0 || size < min)
 		return NULL;
-	do
+	for(int i = 0; random && i < RANDOM_TRIES; i++)
 	{
-		size = p->getSize() > 0xffff ? MAX(p->getAlignedSize(), 0xffff) : p->getSize();
-		size = MIN(size, max);
-		if(best_size < size
-				|| (random && best_size == size && (lrand48() % 1)))
-		{
-			best = p;
-			best_size = size;
-		}
-		p = p->m_next_free;
-		if(p == m_free_list)
-			break;
-	} while(best_size < max || random);
-	if(best_size >= min)
-		return best;
-	else
-		return NULL;
+		uint64_t offset = (lrand48() ^ ((uint64_t) lrand48() << 31)) % m_root->m_free_count;
+		AssignableSet *set = m_root->findFreeAt(offset);
+		if(set->getFreeSize() >= size)
+			return set;
+	}
+	if(m_policy != NULL)
+		return m_policy->pick(this, size);
+	return m_root->findFree(size);
 }
 /*
 AssignableSet* SetDatabase::getFreeSet(uint64_t min, uint64_t max, bool random)
@@ -505,20 +1180,29 @@ void SetDatabase::extract(AssignableSet* &container_set, AddrSet *set)
 	{
 		splitAndInsert(container_set, size);
 	}
-	if(m_free_list == container_set)
-		m_free_list = m_free_list->m_next_free;
-	if(container_set->unchain(this))
-		m_free_list = NULL;
+	unchainFree(container_set, this);
+	update(container_set);
 }
 
 AssignableSet* SetDatabase::findSet(uint64_t count)
 {
+	if(m_buddy && count > 0xffff)
+		return buddyFind(count);
 	AssignableSet *free_set = getFreeSet(1, count);
 	if(free_set == NULL)
 		return NULL;
 	AddrSet set = *free_set;
 	if(MIN(free_set->getSize(),count) > 0xffff)
 		set.alignToMask(SetType::ADDR);
+	else if(m_policy != NULL && m_policy->aligned() && count > 1)
+	{
+		/* At the lowest block of the free set aligned to the size rounded
+		   up, when there is one. */
+		uint64_t block = (uint64_t) 1 << (64 - __builtin_clzll(count - 1));
+		uint64_t first = (free_set->getFirstAddr() + block - 1) & ~(block - 1);
+		if(first + count - 1 <= free_set->getLastAddr())
+			set = AddrSet(first, count, SetSize::AUTO, SetType::ADDR);
+	}
 	if(set.getSize() > count)
 		set.setSize(count);
 	extract(free_set, &set);
@@ -532,7 +1216,10 @@ AssignableSet* SetDatabase::reserve(uint64_t count, uint64_t security_id, uint16
 		return NULL;
 	free_set->m_security_id = security_id;
 	free_set->m_reserved = true;
+	indexSet(free_set);
 	m_protocol->m_event_loop.startTimer(free_set, lifetime);
+	if(m_listener != NULL)
+		m_listener->onLease(this, free_set, lifetime);
 	return free_set;
 }
 
@@ -541,14 +1228,18 @@ AddrSet* SetDatabase::assign(AssignableSet *container_set, AddrSet *set, uint64_
 	if(container_set->m_next_free == NULL)
 	{
 		m_protocol->m_event_loop.stopTimer(container_set);
-		container_set->chain(m_free_list);
-		if(m_free_list == NULL)
-			m_free_list = container_set;
+		if(m_listener != NULL)
+			m_listener->onFree(this, container_set, false);
+		container_set->reclaim();
+		container_set = search(set->getFirstAddr());
 	}
 	extract(container_set, set);
 	container_set->m_security_id = security_id;
 	container_set->m_reserved = false;
+	indexSet(container_set);
 	m_protocol->m_event_loop.startTimer(container_set, lifetime + 1);
+	if(m_listener != NULL)
+		m_listener->onLease(this, container_set, lifetime + 1);
 	return container_set;
 }
 
@@ -557,33 +1248,87 @@ AddrSet* SetDatabase::assign(uint64_t count, uint64_t security_id, uint16_t life
 	AssignableSet *free_set = findSet(count);
 	free_set->m_security_id = security_id;
 	free_set->m_reserved = false;
+	indexSet(free_set);
 	m_protocol->m_event_loop.startTimer(free_set, lifetime + 1);
+	if(m_listener != NULL)
+		m_listener->onLease(this, free_set, lifetime + 1);
 	return free_set;
 }
 
+/* Restarts the timer of a lease, as if it had just been taken again. */
+
+void SetDatabase::renew(AssignableSet *set, uint16_t lifetime)
+{
+	m_protocol->m_event_loop.stopTimer(set);
+	m_protocol->m_event_loop.startTimer(set, lifetime);
+	if(m_listener != NULL)
+		m_listener->onLease(this, set, lifetime);
+}
+
 void SetDatabase::release(AssignableSet *set)
 {
 	m_protocol->m_event_loop.stopTimer(set);
-	set->timeout();
+	if(m_listener != NULL)
+		m_listener->onFree(this, set, false);
+	set->reclaim();
 }	
 
+/* Leases exactly the given set, whatever its current state, without
+   notifying the listener. Used to rebuild the database from the lease
+   journal. */
+
+AssignableSet* SetDatabase::restore(AddrSet *set, uint64_t security_id, bool reserved, double lifetime)
+{
+	AssignableSet *container_set = search(set->getFirstAddr());
+	if(container_set == NULL || container_set->getLastAddr() < set->getLastAddr())
+		return NULL;
+	if(container_set->m_next_free == NULL)
+	{
+		m_protocol->m_event_loop.stopTimer(container_set);
+		container_set->reclaim();
+		container_set = search(set->getFirstAddr());
+	}
+	extract(container_set, set);
+	container_set->m_security_id = security_id;
+	container_set->m_reserved = reserved;
+	indexSet(container_set);
+	m_protocol->m_event_loop.startTimer(container_set, lifetime);
+	return container_set;
+}
+
 DbStatus SetDatabase::checkStatus(AddrSet *set, uint64_t &security_id, 
 									uint16_t &lifetime, bool &identical, AssignableSet *&result)
 {
 	result = search(set->getFirstAddr());
 	if(result != NULL && result->getLastAddr() >= set->getLastAddr())
-	{
-		identical = (result->getSize() == set->getSize());
-		if(result->m_next_free != NULL)
-			return DbStatus::FREE;
-		security_id = result->m_security_id;
-		lifetime = m_protocol->m_event_loop.readTimer(result);
-		if(result->m_reserved)
-			return DbStatus::RESERVED;
-		if(lifetime > 0)
-			lifetime--;
-		return DbStatus::ASSIGNED;
-	}
+		return leaseStatus(result, set, security_id, lifetime, identical);
 	else
 		return DbStatus::INVALID;
 }
+
+/* Same as checkStatus() for a set leased with the given security id,
+   found through the index instead of the tree. */
+
+DbStatus SetDatabase::checkLease(uint64_t security_id, AddrSet *set,
+									uint16_t &lifetime, bool &identical, AssignableSet *&result)
+{
+	result = findLease(security_id, set);
+	if(result == NULL)
+		return DbStatus::INVALID;
+	return leaseStatus(result, set, security_id, lifetime, identical);
+}
+
+DbStatus SetDatabase::leaseStatus(AssignableSet *result, AddrSet *set, uint64_t &security_id,
+									uint16_t &lifetime, bool &identical)
+{
+	identical = (result->getSize() == set->getSize());
+	if(result->m_next_free != NULL)
+		return DbStatus::FREE;
+	security_id = result->m_security_id;
+	lifetime = m_protocol->m_event_loop.readTimer(result);
+	if(result->m_reserved)
+		return DbStatus::RESERVED;
+	if(lifetime > 0)
+		lifetime--;
+	return DbStatus::ASSIGNED;
+}
@@ -2,8 +2,14 @@
 #define DATABASE_H
 #include "addrset.h"
 #include "timer.h"
+#include "pool.h"
+#include "btree.h"
+
+#define BUDDY_ORDERS	64
 
 class Palma;
+class SetDatabase;
+class AllocPolicy;
 
 enum class DbStatus
 {
@@ -20,23 +26,52 @@ public:
 	void *m_ptr;
 	uint64_t m_security_id;
 	bool m_reserved;
+	AssignableSet *m_id_next;
+	AssignableSet **m_id_pprev;
 
 	AssignableSet(uint64_t addr=0, uint64_t count=1);
 	AssignableSet(AddrSet *set);
+	uint64_t getFreeSize();
 	void chain(AssignableSet *set);
 	bool unchain(void *db);
+	void reclaim();
 	void timeout();	
+	TimerGroup *group();
+};
+
+/* One interval of the sorted list SetDatabase::load() builds from. FREE
+   intervals may be listed or left as gaps. */
+
+struct LeaseEntry
+{
+	uint64_t m_first;
+	uint64_t m_count;
+	DbStatus m_status;
+	uint64_t m_security_id;
+	double m_lifetime;
+};
+
+/* Notified of every lease taken or given back through the SetDatabase
+   operations, before the set is merged back into the free space. */
+
+class LeaseListener
+{
+public:
+	virtual void onLease(SetDatabase *db, AssignableSet *set, double lifetime) {}
+	virtual void onFree(SetDatabase *db, AssignableSet *set, bool expired) {}
 };
 
 class TreeNode
 {
 public:
+	SetDatabase *m_db;
 	TreeNode *m_parent;
 	TreeNode *m_child[3];
 	AssignableSet *m_set[2];
+	uint64_t m_max_free;
+	uint64_t m_free_count;
 
-	TreeNode();
-	~TreeNode();
+	TreeNode(SetDatabase *db);
 	TreeNode *locate(uint64_t addr, int &index);
 	AssignableSet *getSet(int index);
 	void setChild(int index, TreeNode *&item);
@@ -48,22 +83,68 @@ public:
 	TreeNode *merge(int index);
 	TreeNode *redistribute();
 	TreeNode *del(int index);
+	void update();
+	void updatePath();
+	AssignableSet *findFree(uint64_t size);
+	AssignableSet *findFreeAt(uint64_t offset);
+	AssignableSet *findBest(uint64_t size, AssignableSet *best);
+	AssignableSet *findFreeFrom(uint64_t addr, uint64_t size);
+	AssignableSet *findAligned(uint64_t block);
 };
 
-class SetDatabase
+class SetDatabase : public TimerGroup
 {
 public:
 	Palma *m_protocol;
 	TreeNode *m_root;
 	AssignableSet *m_free_list;
+	AssignableSet *m_order_list[BUDDY_ORDERS];
+	uint64_t m_order_map;
+	bool m_buddy;
+	AllocPolicy *m_policy;
 	AddrSet m_total_set;
+	ObjectPool<TreeNode> m_node_pool;
+	ObjectPool<AssignableSet> m_set_pool;
+	BTreeIndex m_btree;
+	bool m_use_btree;
+	LeaseListener *m_listener;
+	AssignableSet **m_id_table;
+	uint64_t m_id_size;
+	uint64_t m_id_count;
+	uint64_t m_expire_bursts;
+	uint64_t m_expired;
+	uint64_t m_expire_rebuilds;
+	double m_expire_time;
+	double m_expire_max;
 
 	SetDatabase(Palma *protocol);
 	~SetDatabase();
+	void setHugePages(bool huge);
+	void setBTreeIndex(bool enabled);
+	void setBuddy(bool enabled);
+	void setPolicy(AllocPolicy *policy);
+	void setListener(LeaseListener *listener);
 	void init(AddrSet *set);
+	bool load(AddrSet *set, LeaseEntry *entries, uint64_t n);
+	TreeNode *buildTree(AssignableSet **sets, uint64_t n, int height);
+	void rebuild(AssignableSet **sets, uint64_t n);
+	void clear(TreeNode *node);
+	void collect(TreeNode *node, AssignableSet **sets, uint64_t &n);
 	AssignableSet *search(uint64_t addr);
+	void chainFree(AssignableSet *set);
+	void unchainFree(AssignableSet *set, void *ptr);
+	int freeOrder(AssignableSet *set);
+	AssignableSet *buddyFind(uint64_t count);
+	void indexSet(AssignableSet *set);
+	void unindexSet(AssignableSet *set);
+	void growIndex();
+	AssignableSet *findLease(uint64_t security_id, AddrSet *set = NULL);
 	AssignableSet* splitAndInsert(AssignableSet *set, uint64_t size);
 	void joinAndDelete(AssignableSet *set);
+	void expire(Timer **timers, int n);
+	void expireRuns(AssignableSet **sets, int n);
+	void expireRebuild(AssignableSet **sets, int n);
+	void update(AssignableSet *set);
 	int exclude(AddrSet *set, uint16_t lifetime);
 	AssignableSet* getFreeSet(uint64_t min, uint64_t max, bool random = false);
 
@@ -72,8 +153,12 @@ public:
 	AssignableSet* reserve(uint64_t count, uint64_t security_id, uint16_t lifetime);
 	AddrSet* assign(AssignableSet *container_set, AddrSet *set, uint64_t security_id, uint16_t lifetime);
 	AddrSet* assign(uint64_t count, uint64_t security_id, uint16_t lifetime);
+	void renew(AssignableSet *set, uint16_t lifetime);
 	void release(AssignableSet *set);
+	AssignableSet* restore(AddrSet *set, uint64_t security_id, bool reserved, double lifetime);
 	DbStatus checkStatus(AddrSet *set, uint64_t &security_id, uint16_t &lifetime, bool &identical, AssignableSet *&result);	
+	DbStatus checkLease(uint64_t security_id, AddrSet *set, uint16_t &lifetime, bool &identical, AssignableSet *&result);
+	DbStatus leaseStatus(AssignableSet *result, AddrSet *set, uint64_t &security_id, uint16_t &lifetime, bool &identical);
 };
 
 #endif
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <unistd.h>
 #include "eventloop.h"
 
 bool EventLoop::m_finalize = false;
@@ -11,6 +12,8 @@ EventLoop::EventLoop()
 	FD_ZERO(&m_readfds);
 	m_nfds = 0;
 	m_first_src.m_next = NULL;
+	m_timers = &m_timerlist;
+	m_epfd = epoll_create1(EPOLL_CLOEXEC);
 
 	sigset_t blockset;
 
@@ -28,6 +31,12 @@ EventLoop::EventLoop()
 	sigaction(SIGTERM, &sa, NULL);
 }
 
+EventLoop::~EventLoop()
+{
+	if(m_epfd >= 0)
+		close(m_epfd);
+}
+
 void EventLoop::doExit(int signum)
 {
 	for(ExitHandler *h = m_first_hnd.m_next; h != NULL; h = h->m_next)
@@ -39,6 +48,18 @@ void EventLoop::regSource(EventSource *src)
 {
 	src->m_next = m_first_src.m_next;
 	m_first_src.m_next = src;
+	if(m_epfd >= 0)
+	{
+		epoll_event ev = {0};
+		ev.events = EPOLLIN;
+		ev.data.ptr = src;
+		if(epoll_ctl(m_epfd, EPOLL_CTL_ADD, src->m_fd, &ev) < 0)
+		{
+			perror("Registering event source");
+			exit(1);
+		}
+		return;
+	}
 	FD_SET(src->m_fd, &m_readfds);
 	if(m_nfds < src->m_fd) m_nfds = src->m_fd;
 }
@@ -52,31 +73,41 @@ void EventLoop::regHandler(ExitHandler *hnd)
 void EventLoop::startTimer(Timer *newtimer, double t)
 {
 	if(t != 0.) newtimer->set(t);
-	m_timerlist.add(newtimer);
+	m_timers->add(newtimer);
+}
+
+void EventLoop::startTimers(Timer **timers, int n)
+{
+	m_timers->addAll(timers, n);
 }
 
 void EventLoop::stopTimer(Timer *timer)
 {
-	m_timerlist.del(timer);
+	m_timers->del(timer);
 }
 
 double EventLoop::readTimer(Timer *timer)
 {
-	return m_timerlist.read(timer);
+	return m_timers->read(timer);
 }
 
 void EventLoop::unregSource(EventSource *src)
 {
 	m_nfds = 0;
-	for(EventSource *s = &m_first_src; s != NULL; s = s->m_next)
+	for(EventSource *s = &m_first_src; s->m_next != NULL;)
 	{
 		if(s->m_next == src)
+			s->m_next = src->m_next;
+		else
 		{
-			s->m_next = s->m_next->m_next;
-			FD_CLR(src->m_fd, &m_readfds);
+			s = s->m_next;
+			if(m_nfds < s->m_fd) m_nfds = s->m_fd;
 		}
-		else if(m_nfds < s->m_next->m_fd) m_nfds = s->m_next->m_fd;
 	}
+	if(m_epfd >= 0)
+		epoll_ctl(m_epfd, EPOLL_CTL_DEL, src->m_fd, NULL);
+	else
+		FD_CLR(src->m_fd, &m_readfds);
 }
 
 void EventLoop::unregHandler(ExitHandler *hnd)
@@ -89,19 +120,56 @@ void EventLoop::unregHandler(ExitHandler *hnd)
 		}
 }
 
+/* Runs the timers in another list, shared with other loops, or in the own
+   one again when NULL. Only meant to be called with no timer running. */
+
+void EventLoop::setTimerList(TimerList *timers)
+{
+	m_timers = (timers != NULL) ? timers : &m_timerlist;
+}
+
 void EventLoop::run()
+{
+	if(m_epfd >= 0)
+		runEpoll();
+	else
+		runSelect();
+}
+
+void EventLoop::runEpoll()
+{
+	epoll_event events[MAX_EVENTS];
+	int n, msecs;
+	Time timeout, *next;
+	sigset_t emptyset;
+	sigemptyset(&emptyset);
+	while(!m_finalize)
+	{
+		next = m_timers->check(&timeout);
+		if(m_finalize)
+			break;
+		msecs = (next == NULL) ? -1 : next->tv_sec * 1000 + (next->tv_nsec + 999999) / 1000000;
+		n = epoll_pwait(m_epfd, events, MAX_EVENTS, msecs, &emptyset);
+		for(int i = 0; i < n; i++)
+			((EventSource *) events[i].data.ptr)->onInput();
+	}
+}
+
+void EventLoop::runSelect()
 {
 	fd_set rdfds;
 	int n;
-	Time timeout;
+	Time timeout, *next;
 	sigset_t emptyset;
 	sigemptyset(&emptyset);
 	while(!m_finalize)
 	{ 
 		rdfds = m_readfds;
 
-		n = pselect(m_nfds+1, &rdfds, NULL, NULL, 	
-				m_timerlist.check(&timeout), &emptyset);
+		next = m_timers->check(&timeout);
+		if(m_finalize)
+			break;
+		n = pselect(m_nfds+1, &rdfds, NULL, NULL, next, &emptyset);
 		for(EventSource *s = m_first_src.m_next; s != NULL && n > 0; s = s->m_next)
 		{
 			if(FD_ISSET(s->m_fd, &rdfds))
@@ -112,4 +180,3 @@ void EventLoop::run()
 		}
 	}
 }
-
@@ -3,6 +3,9 @@
 
 #include "timer.h"
 #include <sys/select.h>
+#include <sys/epoll.h>
+
+#define MAX_EVENTS	64
 
 class EventSource
 {
@@ -21,27 +24,38 @@ public:
 	virtual void onExit() {}
 };
 
+/* Sources are watched with epoll, each one registered with its own
+   pointer as event data. pselect over the source list is kept as a
+   fallback when epoll is not available. */
+
 class EventLoop
 {
+	int m_epfd;
 	fd_set m_readfds;
 	int m_nfds;
 	EventSource m_first_src;
 	TimerList m_timerlist;
+	TimerList *m_timers;
 
 	static void doExit(int signum);
+	void runEpoll();
+	void runSelect();
 
 public:
 	static ExitHandler m_first_hnd;
 	static bool m_finalize;
 
 	EventLoop();
+	~EventLoop();
 	void regSource(EventSource *src);
 	void regHandler(ExitHandler *hnd);
 	void startTimer(Timer *newtimer, double t = 0.);
+	void startTimers(Timer **timers, int n);
 	void stopTimer(Timer *timer);
 	double readTimer(Timer *timer);
 	void unregSource(EventSource *src);
 	void unregHandler(ExitHandler *hnd);
+	void setTimerList(TimerList *timers);
 	void run();
 };
 
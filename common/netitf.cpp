@@ -6,6 +6,8 @@
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
+#include <sys/mman.h>
+#include <linux/filter.h>
 #include <memory.h>
 #include <unistd.h>
 
@@ -14,7 +16,75 @@
 #include "palma.h"
 #include "packet.h"
 
-NetItf::NetItf(Palma *protocol) : m_protocol(protocol){}
+NetItf::NetItf(Palma *protocol) : m_protocol(protocol),
+									m_transport(NULL),
+									m_batch(DEFAULT_RX_BATCH),
+									m_rcvbuf(NULL),
+									m_iov(NULL),
+									m_msgs(NULL),
+									m_pkts(NULL),
+									m_batch_pkts(NULL),
+									m_ring_enabled(false),
+									m_promisc(false),
+									m_ring(NULL),
+									m_ring_cur(0),
+									m_filter_addr(NULL),
+									m_filter_refs(NULL),
+									m_filter_naddr(0),
+									m_filter_size(0),
+									m_mcast_types(ALL_MSG_TYPES),
+									m_rx_wakeups(0),
+									m_rx_calls(0),
+									m_rx_frames(0)
+{
+	m_fd = -1;
+}
+
+void NetItf::setBatchSize(int batch)
+{
+	if(batch > 0)
+		m_batch = batch;
+}
+
+void NetItf::setRxRing(bool enabled)
+{
+	m_ring_enabled = enabled;
+}
+
+/* TPACKET_V3 ring: the kernel fills whole blocks of frames and hands them
+   over by setting TP_STATUS_USER. Frames are parsed in place and the
+   block is given back once they have been handled. */
+
+void NetItf::initRing()
+{
+	int version = TPACKET_V3;
+	tpacket_req3 req = {0};
+
+	if(setsockopt(m_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+	{
+		perror("Setting packet version");
+		exit(1);
+	}
+	req.tp_block_size = RX_RING_BLOCK_SIZE;
+	req.tp_block_nr = RX_RING_BLOCKS;
+	req.tp_frame_size = RX_RING_FRAME_SIZE;
+	req.tp_frame_nr = RX_RING_BLOCK_SIZE / RX_RING_FRAME_SIZE * RX_RING_BLOCKS;
+	req.tp_retire_blk_tov = RX_RING_TIMEOUT;
+	if(setsockopt(m_fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+	{
+		perror("Setting up receive ring");
+		exit(1);
+	}
+	m_ring = (uint8_t *) mmap(NULL, RX_RING_BLOCK_SIZE * RX_RING_BLOCKS, 
+						PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if(m_ring == MAP_FAILED)
+	{
+		m_ring = NULL;
+		perror("Mapping receive ring");
+		exit(1);
+	}
+	m_ring_cur = 0;
+}
 
 void NetItf::init(uint8_t *ifname)
 {
@@ -36,6 +106,8 @@ void NetItf::init(uint8_t *ifname)
 		exit(1);
 	}
 	m_ifidx = ifbuf.ifr_ifindex;
+	if(m_ring_enabled)
+		initRing();
 	saddr.sll_family = AF_PACKET;
 	saddr.sll_ifindex = m_ifidx;
 	saddr.sll_halen = ETH_ALEN;
@@ -46,36 +118,159 @@ void NetItf::init(uint8_t *ifname)
 		perror("Binding datagram socket");
 		exit(1);
 	}
+
+	updateFilter();
+	m_pkts = new PacketView[m_batch];
+	m_batch_pkts = new PacketView *[m_batch];
+	if(m_ring != NULL)
+		return;
+	m_rcvbuf = new uint8_t[m_batch * (MAX_PKT_SIZE+1)];
+	m_iov = new iovec[m_batch];
+	m_msgs = new mmsghdr[m_batch];
+	memset(m_msgs, 0, m_batch * sizeof(mmsghdr));
+	for(int i=0; i<m_batch; i++)
+	{
+		m_iov[i].iov_base = m_rcvbuf + i * (MAX_PKT_SIZE+1);
+		m_iov[i].iov_len = MAX_PKT_SIZE+1;
+		m_msgs[i].msg_hdr.msg_iov = &m_iov[i];
+		m_msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+/* Frames go through the transport instead of a socket. Frames are handed
+   over one at a time, so a batch of one is enough. */
+
+void NetItf::init(Transport *transport)
+{
+	m_transport = transport;
+	m_batch = 1;
+	m_pkts = new PacketView[m_batch];
+	m_batch_pkts = new PacketView *[m_batch];
+	for(int i=0; i<m_filter_naddr; i++)
+		m_transport->join(this, m_filter_addr[i]);
 }
 
 NetItf::~NetItf()
 {
-	close(m_fd);
+	if(m_transport != NULL)
+	{
+		for(int i=0; i<m_filter_naddr; i++)
+			m_transport->leave(this, m_filter_addr[i]);
+	}
+	if(m_ring != NULL)
+		munmap(m_ring, RX_RING_BLOCK_SIZE * RX_RING_BLOCKS);
+	if(m_fd >= 0)
+		close(m_fd);
+	delete[] m_rcvbuf;
+	delete[] m_iov;
+	delete[] m_msgs;
+	delete[] m_pkts;
+	delete[] m_batch_pkts;
+	free(m_filter_addr);
+	free(m_filter_refs);
+}
+
+void NetItf::queue(uint8_t *data, int len, int &npkt)
+{
+	PacketView *pkt = &m_pkts[npkt];
+	if(pkt->parse(data, len) == 0)
+		m_batch_pkts[npkt++] = pkt;
+	if(npkt == m_batch)
+		flush(npkt);
+}
+
+void NetItf::flush(int &npkt)
+{
+	if(npkt > 0)
+		m_protocol->handleBatch(m_batch_pkts, npkt);
+	npkt = 0;
+}
+
+int NetItf::onRingInput()
+{
+	int npkt = 0;
+	for(;;)
+	{
+		tpacket_block_desc *block = (tpacket_block_desc *)(m_ring + m_ring_cur * RX_RING_BLOCK_SIZE);
+		if(!(block->hdr.bh1.block_status & TP_STATUS_USER))
+			break;
+		m_rx_calls++;
+		m_rx_frames += block->hdr.bh1.num_pkts;
+		uint8_t *p = (uint8_t *)block + block->hdr.bh1.offset_to_first_pkt;
+		for(uint32_t i = 0; i < block->hdr.bh1.num_pkts; i++)
+		{
+			tpacket3_hdr *hdr = (tpacket3_hdr *) p;
+			queue(p + hdr->tp_mac, hdr->tp_snaplen, npkt);
+			p += hdr->tp_next_offset;
+		}
+		flush(npkt);
+		__sync_synchronize();
+		block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+		m_ring_cur = (m_ring_cur + 1) % RX_RING_BLOCKS;
+	}
+	return 0;
 }
 
+/* Frames are read in batches of up to m_batch with a single recvmmsg call.
+   A short batch means the socket queue is drained, so no further call is
+   made until the next wakeup. With the receive ring enabled, every block
+   handed over by the kernel counts as one call. */
+
 int NetItf::onInput()
 {
-	uint8_t rcvbuf[MAX_PKT_SIZE+1];
-	int rcvlen;
+	int nfrm;
 
-	while ((rcvlen = recv(m_fd, rcvbuf, MAX_PKT_SIZE+1, MSG_DONTWAIT)) >= 0)
+	m_rx_wakeups++;
+	if(m_ring != NULL)
+		return onRingInput();
+	while ((nfrm = recvmmsg(m_fd, m_msgs, m_batch, MSG_DONTWAIT, NULL)) > 0)
 	{
-		Packet pkt;											//solo para depurar
-		/*		
-		printf("\nRecibidos %d bytes\n",rcvlen);
-		printf("\nDATA->");
-		for(int i=0; i<rcvlen; i++)
-			printf("%02x ",rcvbuf[i]);
-		printf("\n");
-		*/
-		if(pkt.parse(rcvbuf, rcvlen) == 0 && pkt.check())
-			m_protocol->handlePacket(&pkt);
+		int npkt = 0;
+		m_rx_calls++;
+		m_rx_frames += nfrm;
+		for(int i=0; i<nfrm; i++)
+			queue((uint8_t *)m_iov[i].iov_base, m_msgs[i].msg_len, npkt);
+		flush(npkt);
+		if(nfrm < m_batch)
+			return 0;
 	}
-	if (errno != EAGAIN && errno != EWOULDBLOCK)
+	if (nfrm < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
 	{
 		perror("Reading from network socket");
 		exit(1);
 	}
+	return 0;
+}
+
+/* Same checks as the socket filter: the DA must be one of the addresses
+   added and, for PALMA_MCAST, the message type one of m_mcast_types. */
+
+bool NetItf::accepts(uint8_t *data, int len)
+{
+	if(len < ETH_HDR_SIZE + 2)
+		return false;
+	uint64_t addr = 0;
+	for(int i=0; i<6; i++)
+		addr = (addr << 8) | data[i];
+	for(int i=0; i<m_filter_naddr; i++)
+	{
+		if(m_filter_addr[i] != addr)
+			continue;
+		if(addr == PALMA_MCAST)
+			return (m_mcast_types >> (data[ETH_HDR_SIZE + 1] & 0x1f)) & 1;
+		return true;
+	}
+	return false;
+}
+
+void NetItf::receive(uint8_t *data, int len)
+{
+	int npkt = 0;
+	m_rx_wakeups++;
+	m_rx_calls++;
+	m_rx_frames++;
+	queue(data, len, npkt);
+	flush(npkt);
 }
 
 void NetItf::netsend(Packet *pkt)
@@ -83,7 +278,17 @@ void NetItf::netsend(Packet *pkt)
 	uint8_t sndbuf[MAX_PKT_SIZE];
 
 	uint16_t len = pkt->toBuffer(sndbuf);
-	int res = send(m_fd, sndbuf, len, 0);
+	netsend(sndbuf, len);
+}
+
+void NetItf::netsend(uint8_t *data, int len)
+{
+	if(m_transport != NULL)
+	{
+		m_transport->send(this, data, len);
+		return;
+	}
+	int res = send(m_fd, data, len, 0);
 	if(res	< 0)
 	{
 		perror("Sending packet");
@@ -92,11 +297,155 @@ void NetItf::netsend(Packet *pkt)
 	/*
 	printf("\nEnviados %d bytes->\n",res);
 	for(int i=0; i<res; i++)
-		printf("%02x ",sndbuf[i]);
+		printf("%02x ",data[i]);
 	printf("\n");
 	*/
 }
 
+void NetItf::setMcastTypes(uint32_t types)
+{
+	m_mcast_types = types;
+	if(m_fd >= 0)
+		updateFilter();
+}
+
+/* Every PALMA frame on the link is received, whatever its DA, for
+   programs that sort the frames out themselves. */
+
+void NetItf::setPromiscuous()
+{
+	packet_mreq mreq = {0};
+	mreq.mr_ifindex = m_ifidx;
+	mreq.mr_type = PACKET_MR_PROMISC;
+
+	int res = setsockopt(m_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+	if(res	< 0)
+	{
+		perror("Setting promiscuous mode");
+		exit(1);
+	}
+	m_promisc = true;
+	updateFilter();
+}
+
+void NetItf::addFilterAddr(uint64_t addr)
+{
+	for(int i=0; i<m_filter_naddr; i++)
+	{
+		if(m_filter_addr[i] == addr)
+		{
+			m_filter_refs[i]++;
+			return;
+		}
+	}
+	if(m_filter_naddr == m_filter_size)
+	{
+		m_filter_size = m_filter_size ? 2 * m_filter_size : 8;
+		m_filter_addr = (uint64_t *) realloc(m_filter_addr, m_filter_size * sizeof(uint64_t));
+		m_filter_refs = (int *) realloc(m_filter_refs, m_filter_size * sizeof(int));
+		if(m_filter_addr == NULL || m_filter_refs == NULL)
+		{
+			perror("Growing address filter");
+			exit(1);
+		}
+	}
+	m_filter_addr[m_filter_naddr] = addr;
+	m_filter_refs[m_filter_naddr++] = 1;
+	if(m_transport != NULL)
+		m_transport->join(this, addr);
+	updateFilter();
+}
+
+void NetItf::delFilterAddr(uint64_t addr)
+{
+	for(int i=0; i<m_filter_naddr; i++)
+	{
+		if(m_filter_addr[i] == addr)
+		{
+			if(--m_filter_refs[i] == 0)
+			{
+				if(m_transport != NULL)
+					m_transport->leave(this, addr);
+				m_filter_naddr--;
+				m_filter_addr[i] = m_filter_addr[m_filter_naddr];
+				m_filter_refs[i] = m_filter_refs[m_filter_naddr];
+				updateFilter();
+			}
+			return;
+		}
+	}
+}
+
+/*
+ * Classic BPF program accepting only frames whose DA is one of the
+ * addresses added to the interface. For every address:
+ *
+ *		ld [0]; jeq #hi, 0, next; ldh [4]; jeq #lo, 0, next; ret #accept
+ *
+ * and, for PALMA_MCAST, the message type is checked against m_mcast_types
+ * before accepting. When the program would not fit in BPF_MAXINSNS, or
+ * the interface is promiscuous, the filter is removed and every frame
+ * reaches onInput.
+ */
+
+#define FILTER_ACCEPT		0xffff
+#define UCAST_BLOCK_LEN		5
+#define MCAST_BLOCK_LEN		11
+
+void NetItf::updateFilter()
+{
+	if(m_fd < 0)
+		return;
+	int len = 1;
+	for(int i=0; i<m_filter_naddr; i++)
+		len += (m_filter_addr[i] == PALMA_MCAST) ? MCAST_BLOCK_LEN : UCAST_BLOCK_LEN;
+	if(m_promisc || len > BPF_MAXINSNS)
+	{
+		int none = 0;
+		if(setsockopt(m_fd, SOL_SOCKET, SO_DETACH_FILTER, &none, sizeof(none)) < 0 && errno != ENOENT)
+		{
+			perror("Detaching socket filter");
+			exit(1);
+		}
+		return;
+	}
+
+	sock_filter *code = new sock_filter[len];
+	sock_filter *p = code;
+	for(int i=0; i<m_filter_naddr; i++)
+	{
+		uint64_t addr = m_filter_addr[i];
+		uint8_t skip = (addr == PALMA_MCAST) ? MCAST_BLOCK_LEN : UCAST_BLOCK_LEN;
+		uint8_t skip_hi = skip - 2, skip_lo = skip - 4;
+		*p++ = (sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0);
+		*p++ = (sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)(addr >> 16), 0, skip_hi);
+		*p++ = (sock_filter) BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 4);
+		*p++ = (sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)(addr & 0xffff), 0, skip_lo);
+		if(addr == PALMA_MCAST)
+		{
+			*p++ = (sock_filter) BPF_STMT(BPF_LD | BPF_B | BPF_ABS, ETH_HDR_SIZE + 1);
+			*p++ = (sock_filter) BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x1f);
+			*p++ = (sock_filter) BPF_STMT(BPF_MISC | BPF_TAX, 0);
+			*p++ = (sock_filter) BPF_STMT(BPF_LD | BPF_IMM, m_mcast_types);
+			*p++ = (sock_filter) BPF_STMT(BPF_ALU | BPF_RSH | BPF_X, 0);
+			*p++ = (sock_filter) BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 1, 0, 1);
+		}
+		*p++ = (sock_filter) BPF_STMT(BPF_RET | BPF_K, FILTER_ACCEPT);
+	}
+	*p++ = (sock_filter) BPF_STMT(BPF_RET | BPF_K, 0);
+
+	sock_fprog prog;
+	prog.len = len;
+	prog.filter = code;
+	int res = setsockopt(m_fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+	delete[] code;
+	if(res < 0)
+	{
+		perror("Attaching socket filter");
+		exit(1);
+	}
+}
+
 void NetItf::fillMreq(packet_mreq& mreq, uint64_t addr, bool multicast)
 {
 	addr = htobe64(addr);
@@ -108,6 +457,11 @@ void NetItf::fillMreq(packet_mreq& mreq, uint64_t addr, bool multicast)
 
 void NetItf::addAddr(uint64_t addr, bool multicast)
 {
+	if(m_transport != NULL)
+	{
+		addFilterAddr(addr);
+		return;
+	}
 	packet_mreq mreq = {0};
 	fillMreq(mreq, addr, multicast);
 
@@ -117,10 +471,16 @@ void NetItf::addAddr(uint64_t addr, bool multicast)
 		perror("Adding address to filter");
 		exit(1);
 	}
+	addFilterAddr(addr);
 }
 
 void NetItf::delAddr(uint64_t addr, bool multicast)
 {
+	if(m_transport != NULL)
+	{
+		delFilterAddr(addr);
+		return;
+	}
 	packet_mreq mreq = {0};
 	fillMreq(mreq, addr, multicast);
 
@@ -130,5 +490,6 @@ void NetItf::delAddr(uint64_t addr, bool multicast)
 		perror("Dropping address to filter");
 		exit(1);
 	}
+	delFilterAddr(addr);
 }
 
@@ -2,23 +2,80 @@
 #define NETITF_H
 
 #include <linux/if_packet.h>
+#include <sys/socket.h>
 #include <stdint.h>
 #include "eventloop.h"
 #include "packet.h"
 
+#define DEFAULT_RX_BATCH	16
+#define RX_RING_BLOCK_SIZE	(1 << 16)
+#define RX_RING_BLOCKS		64
+#define RX_RING_FRAME_SIZE	2048
+#define RX_RING_TIMEOUT		1	/* ms before a partially filled block is retired */
+
 class Palma;
+class NetItf;
+
+/* Medium a NetItf sends through instead of its packet socket. It is told
+   of every address the interface starts or stops receiving, and hands the
+   frames over with NetItf::receive(). */
+
+class Transport
+{
+public:
+	virtual void join(NetItf *itf, uint64_t addr) = 0;
+	virtual void leave(NetItf *itf, uint64_t addr) = 0;
+	virtual void send(NetItf *itf, uint8_t *data, int len) = 0;
+	virtual ~Transport() {}
+};
 
 class NetItf : public EventSource
 {
 	int m_ifidx;
+	Transport *m_transport;
 	Palma *m_protocol;
+	int m_batch;
+	uint8_t *m_rcvbuf;
+	iovec *m_iov;
+	mmsghdr *m_msgs;
+	PacketView *m_pkts;
+	PacketView **m_batch_pkts;
+	bool m_ring_enabled;
+	bool m_promisc;
+	uint8_t *m_ring;
+	int m_ring_cur;
+	uint64_t *m_filter_addr;
+	int *m_filter_refs;
+	int m_filter_naddr;
+	int m_filter_size;
+	uint32_t m_mcast_types;
+
+	void initRing();
+	void queue(uint8_t *data, int len, int &npkt);
+	void flush(int &npkt);
+	int onRingInput();
+	void addFilterAddr(uint64_t addr);
+	void delFilterAddr(uint64_t addr);
+	void updateFilter();
 	
 public:
+	uint64_t m_rx_wakeups;
+	uint64_t m_rx_calls;
+	uint64_t m_rx_frames;
+
 	NetItf(Palma *protocol);
 	~NetItf();
+	void setBatchSize(int batch);
+	void setRxRing(bool enabled);
+	void setMcastTypes(uint32_t types);
+	void setPromiscuous();
 	void init(uint8_t *ifname);
+	void init(Transport *transport);
 	int onInput();
+	bool accepts(uint8_t *data, int len);
+	void receive(uint8_t *data, int len);
 	void netsend(Packet *pkt);
+	void netsend(uint8_t *data, int len);
 	void fillMreq(packet_mreq& mreq, uint64_t addr, bool multicast);
 	void addAddr(uint64_t addr, bool multicast = false);
 	void delAddr(uint64_t addr, bool multicast = false);
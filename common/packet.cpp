@@ -52,43 +52,21 @@ int IdPar::toBuffer(uint8_t *&data)
 	return len + m_length;
 }
 
-PacketPar* IdPar::clone()
-{
-	return new IdPar(m_par_id, m_id, m_length);
-}
-
-MacSetPar::MacSetPar(uint8_t *data, uint8_t len) : PacketPar(ParType::MAC_ADDR_SET, len) 
+MacSetPar::MacSetPar(AddrSet &set) : m_set(set), PacketPar(ParType::MAC_ADDR_SET, length(set)) {}
+ 
+static void setMacSet(AddrSet *set, uint8_t *&data)
 {
-	uint64_t addr;
-	
-	if (len < 12)
-	{	
-		uint16_t count;
-		len -= 2;
-		addr = Packet::get64(data, len);
-		count = Packet::get16(data);
-		m_set = AddrSet(addr, count, (len == 6) ? SetSize::SIZE48 : SetSize::SIZE64, SetType::ADDR);
-	}
+	Packet::set64(set->getFirstAddr(), data, set->addrLen());
+	if (set->getType() == SetType::ADDR)
+		Packet::set16(set->getSize(), data);
 	else
-	{
-		uint64_t mask;
-		len /= 2;
-		addr = Packet::get64(data, len);
-		mask = Packet::get64(data, len);
-		m_set = AddrSet(addr, mask, (len == 6) ? SetSize::SIZE48 : SetSize::SIZE64, SetType::MASK);
-	}	
-}	
+		Packet::set64(set->getMask(), data, set->addrLen());
+}
 
-MacSetPar::MacSetPar(AddrSet &set) : m_set(set), PacketPar(ParType::MAC_ADDR_SET, length(set)) {}
- 
 int MacSetPar::toBuffer(uint8_t *&data)
 {
 	int len = PacketPar::toBuffer(data);
-	Packet::set64(m_set.getFirstAddr(), data, m_set.addrLen());
-	if (m_set.getType() == SetType::ADDR)
-		Packet::set16(m_set.getSize(), data);
-	else
-		Packet::set64(m_set.getMask(), data, m_set.addrLen());
+	setMacSet(&m_set, data);
 	return len + m_length;
 }
 
@@ -101,16 +79,6 @@ uint8_t MacSetPar::length(AddrSet &set)
 		return len * 2;
 }
 
-PacketPar* MacSetPar::clone()
-{
-	return new MacSetPar(m_set);
-}
-
-LifetimePar::LifetimePar(uint8_t *data, uint8_t len) : PacketPar(ParType::LIFETIME, len)
-{
-	m_lifetime = Packet::get16(data);
-}	
-
 LifetimePar::LifetimePar(uint16_t lifetime) : 
 				PacketPar(ParType::LIFETIME, 2), m_lifetime(lifetime) {}
 
@@ -121,17 +89,6 @@ int LifetimePar::toBuffer(uint8_t *&data)
 	return len + m_length;
 }
 
-PacketPar* LifetimePar::clone()
-{
-	return new LifetimePar(m_lifetime);
-}
-
-ClientAddrPar::ClientAddrPar(uint8_t *data, uint8_t len) : PacketPar(ParType::CLIENT_ADDR, len) 
-{
-	uint64_t addr = Packet::get64(data, len);
-	m_set = AddrSet(addr, 1, (len == 6) ? SetSize::SIZE48 : SetSize::SIZE64, SetType::ADDR);	
-}	
-
 ClientAddrPar::ClientAddrPar(AddrSet &set) : m_set(set), PacketPar(ParType::CLIENT_ADDR, set.addrLen()) {}
  
 int ClientAddrPar::toBuffer(uint8_t *&data)
@@ -141,11 +98,6 @@ int ClientAddrPar::toBuffer(uint8_t *&data)
 	return len + m_length;
 }
 
-PacketPar* ClientAddrPar::clone()
-{
-	return new ClientAddrPar(m_set);
-}
-
 VendorPar::VendorPar(uint8_t *data, uint8_t var_len) : PacketPar(ParType::VENDOR, var_len) 
 {
 	m_var = new uint8_t[var_len];
@@ -165,24 +117,6 @@ int VendorPar::toBuffer(uint8_t *&data)
 	return len + m_length;
 }
 
-PacketPar* VendorPar::clone()
-{
-	return new VendorPar(m_var, m_length);
-}
-
-Packet::Packet()
-{	
-	for(m_num_par = 0; m_num_par < MAX_PAR; m_num_par++)
-		m_par[m_num_par] = NULL;
-}
-
-Packet::Packet(Packet *pkt)
-{
-	*this = *pkt;
-	for(int num_par = 0; num_par < m_num_par; num_par++)
-		m_par[num_par] = pkt->m_par[num_par]->clone();
-}
-
 Packet::Packet(MsgType type, uint64_t DA, uint64_t SA, uint16_t token, StatusCode status)
 {
 	m_DA = DA;
@@ -218,9 +152,14 @@ int Packet::addPar(PacketPar *par)
 }
 
 int Packet::addIdPar(ParType par_id, uint8_t *id)
+{
+	return addIdPar(par_id, id, strlen((char *)id));
+}
+
+int Packet::addIdPar(ParType par_id, uint8_t *id, uint8_t len)
 {
 	m_control_word |= (par_id == ParType::STATION_ID) ? STATIONID_CW : NETWORKID_CW;
-	return addPar(new IdPar(par_id, id, strlen((char *)id)));
+	return addPar(new IdPar(par_id, id, len));
 }
 
 int Packet::addMacSetPar(AddrSet *set, bool update_cw)
@@ -246,49 +185,6 @@ int Packet::addVendorPar(uint8_t *var, uint8_t var_len)
 	return addPar(new VendorPar(var, var_len));
 }
 
-int Packet::parsePar(uint8_t *&data, int &len, PacketPar *&par)
-{
-	ParType par_id = (ParType)*data++;
-	uint8_t par_len = *data++;
-	if(len < par_len)
-		return -1;
-	par_len -= 2;
-	switch(par_id)
-	{
-		case ParType::STATION_ID :
-		case ParType::NETWORK_ID :
-			if (par_len <= 1)
-				return -1;
-			par = new IdPar(par_id, data, par_len);
-			break;
-		case ParType::MAC_ADDR_SET :
-			if (par_len != 8 && par_len != 10 && par_len != 12 && par_len != 16)
-				return -1;
-			par = new MacSetPar(data, par_len);
-			break;
-		case ParType::CLIENT_ADDR : 
-			if (par_len != 6 && par_len != 8)
-				return -1;
-			par = new ClientAddrPar(data, par_len);
-			break;
-		case ParType::LIFETIME :
-			if (par_len != 2)
-				return -1;
-			par = new LifetimePar(data, par_len);
-			break;
-		case ParType::VENDOR :
-			if (par_len <= 1)
-				return -1;
-			par = new VendorPar(data, par_len);
-			break;
-		default:
-			return -1;		
-	}
-	data += par_len;
-	len -= par_len + 2;
-	return 0;
-}
-
 uint64_t Packet::get64(uint8_t *&p, uint8_t nbytes)
 {
 	uint64_t tmp64;
@@ -325,21 +221,211 @@ void Packet::set16(uint16_t val, uint8_t *&p)
 	p += 2;
 }
 
-int Packet::parse(uint8_t *data, int len)
+int Packet::toBuffer(uint8_t *data)
+{
+	set64(m_DA, data, 6);		
+	set64(m_SA, data, 6);	
+	set16(PALMA_TYPE, data);	
+	*data++ = PALMA_SUBTYPE;
+	*data++ = (m_version << 5) | (uint8_t) m_message_type;
+	set16(m_control_word, data);
+	set16(m_token, data);
+	*data++ = ((uint8_t) m_status << 4) | (m_length >> 8);
+	*data++ = m_length & 0xFF;
+
+	int len = MIN_PKT_SIZE;
+
+	for(int m_num_par = 0 ; m_num_par < MAX_PAR && m_par[m_num_par] != NULL; m_num_par++)
+		len += m_par[m_num_par]->toBuffer(data);
+
+	return len;
+}
+
+void Packet::setSA(uint64_t addr)
+{
+	m_SA = addr;
+}
+
+void Packet::setRenewal()
+{
+	m_control_word |= RENEWAL_CW;
+}
+
+PacketTemplate::PacketTemplate() : m_control_word(0), m_fixed_len(MIN_PKT_SIZE) {}
+
+void PacketTemplate::init(MsgType type, uint64_t SA)
+{
+	uint8_t *data = m_buf + 6;
+
+	Packet::set64(SA, data, 6);
+	Packet::set16(PALMA_TYPE, data);
+	*data++ = PALMA_SUBTYPE;
+	*data++ = (uint8_t) type;
+	m_control_word = (type == MsgType::OFFER || type == MsgType::ACK) ? SERVER_CW : 0;
+	m_fixed_len = MIN_PKT_SIZE;
+}
+
+void PacketTemplate::addConstPar(ParType par_id, uint8_t *data, uint8_t len)
+{
+	m_buf[m_fixed_len++] = (uint8_t) par_id;
+	m_buf[m_fixed_len++] = len + 2;
+	memcpy(m_buf + m_fixed_len, data, len);
+	m_fixed_len += len;
+}
+
+void PacketTemplate::addIdPar(ParType par_id, uint8_t *id)
+{
+	m_control_word |= (par_id == ParType::STATION_ID) ? STATIONID_CW : NETWORKID_CW;
+	addConstPar(par_id, id, strlen((char *)id));
+}
+
+void PacketTemplate::addVendorPar(uint8_t *var, uint8_t var_len)
+{
+	m_control_word |= VENDOR_CW;
+	addConstPar(ParType::VENDOR, var, var_len);
+}
+
+int PacketTemplate::fill(uint64_t DA, uint16_t token, StatusCode status, AddrSet *set, uint16_t lifetime, 
+							uint8_t *station_id, uint8_t station_id_len, AddrSet *client_addr)
+{
+	uint16_t control_word = m_control_word;
+	uint8_t *data = m_buf + m_fixed_len;
+
+	if(set != NULL)
+	{
+		control_word |= SETPROV_CW | set->slapType();
+		*data++ = (uint8_t) ParType::LIFETIME;
+		*data++ = 4;
+		Packet::set16(lifetime, data);
+		*data++ = (uint8_t) ParType::MAC_ADDR_SET;
+		*data++ = MacSetPar::length(*set) + 2;
+		setMacSet(set, data);
+	}
+	if(station_id != NULL)
+	{
+		control_word |= STATIONID_CW;
+		*data++ = (uint8_t) ParType::STATION_ID;
+		*data++ = station_id_len + 2;
+		memcpy(data, station_id, station_id_len);
+		data += station_id_len;
+	}
+	if(client_addr != NULL)
+	{
+		*data++ = (uint8_t) ParType::CLIENT_ADDR;
+		*data++ = client_addr->addrLen() + 2;
+		Packet::set64(client_addr->m_addr, data, client_addr->addrLen());
+	}
+	if((uint8_t) status != 0)
+		control_word |= CODEFIELD_CW;
+
+	int len = data - m_buf;
+	uint16_t length = len - ETH_HDR_SIZE;
+	data = m_buf;
+	Packet::set64(DA, data, 6);
+	data = m_buf + ETH_HDR_SIZE + 2;
+	Packet::set16(control_word, data);
+	Packet::set16(token, data);
+	*data++ = ((uint8_t) status << 4) | (length >> 8);
+	*data++ = length & 0xFF;
+	return len;
+}
+
+uint8_t *PacketTemplate::getData()
+{
+	return m_buf;
+}
+
+PacketView::PacketView() : m_data(NULL), m_frame_len(0) {}
+
+int PacketView::parsePar(uint8_t *&data, int &len, uint8_t *par_cnt)
+{
+	ParType par_id = (ParType)*data++;
+	uint8_t par_len = *data++;
+	uint8_t *p = data;
+	if(len < par_len || par_len < 2)
+		return -1;
+	par_len -= 2;
+	switch(par_id)
+	{
+		case ParType::STATION_ID :
+			if (par_len <= 1 || !(m_control_word & STATIONID_CW))
+				return -1;
+			m_station_id = data;
+			m_station_id_len = par_len;
+			break;
+		case ParType::NETWORK_ID :
+			if (par_len <= 1 || !(m_control_word & NETWORKID_CW))
+				return -1;
+			m_network_id = data;
+			m_network_id_len = par_len;
+			break;
+		case ParType::MAC_ADDR_SET :
+			if (par_len != 8 && par_len != 10 && par_len != 12 && par_len != 16)
+				return -1;
+			if (m_num_set == 2)
+				return -1;
+			if (par_len < 12)
+			{
+				uint8_t addr_len = par_len - 2;
+				uint64_t addr = Packet::get64(p, addr_len);
+				uint16_t count = Packet::get16(p);
+				m_set[m_num_set] = AddrSet(addr, count, (addr_len == 6) ? SetSize::SIZE48 : SetSize::SIZE64, SetType::ADDR);
+			}
+			else
+			{
+				uint8_t addr_len = par_len / 2;
+				uint64_t addr = Packet::get64(p, addr_len);
+				uint64_t mask = Packet::get64(p, addr_len);
+				m_set[m_num_set] = AddrSet(addr, mask, (addr_len == 6) ? SetSize::SIZE48 : SetSize::SIZE64, SetType::MASK);
+			}
+			if((m_control_word & (SETPROV_CW | SLAP_CW)) != (SETPROV_CW | m_set[m_num_set].slapType()))
+				return -1;
+			m_num_set++;
+			break;
+		case ParType::CLIENT_ADDR :
+			if (par_len != 6 && par_len != 8)
+				return -1;
+			m_client_addr = Packet::get64(p, par_len);
+			break;
+		case ParType::LIFETIME :
+			if (par_len != 2)
+				return -1;
+			m_lifetime = Packet::get16(p);
+			break;
+		case ParType::VENDOR :
+			if (par_len <= 1 || !(m_control_word & VENDOR_CW))
+				return -1;
+			m_vendor_var = data;
+			m_vendor_var_len = par_len;
+			break;
+		default:
+			return -1;
+	}
+	par_cnt[(uint8_t)par_id]++;
+	data += par_len;
+	len -= par_len + 2;
+	return 0;
+}
+
+int PacketView::parse(uint8_t *data, int len)
 {
+	uint8_t par_cnt[(uint8_t) ParType::MAX_PARTYPE] = {0};
+
 	if(len < MIN_PKT_SIZE || len > MAX_PKT_SIZE)
 		return -1;
 
-	m_DA = get64(data, 6);		
-	m_SA = get64(data, 6);
+	m_data = data;
+	m_frame_len = len;
+	m_DA = Packet::get64(data, 6);
+	m_SA = Packet::get64(data, 6);
 
-	if(get16(data) != PALMA_TYPE || *data++ != PALMA_SUBTYPE)
+	if(Packet::get16(data) != PALMA_TYPE || *data++ != PALMA_SUBTYPE)
 		return -1;
 
 	m_version = (*data & 0xE0) >> 5;
 	m_message_type = (MsgType)(*data++ & 0x1F);
-	m_control_word = get16(data);
-	m_token = get16(data);
+	m_control_word = Packet::get16(data);
+	m_token = Packet::get16(data);
 	m_status = (StatusCode) ((*data & 0xF0) >> 4);
 	m_length = ((uint16_t)(*data++ & 0x0F)) << 8;
 	m_length |= (*data++);
@@ -348,50 +434,28 @@ int Packet::parse(uint8_t *data, int len)
 	if(len != m_length - HEADER_SIZE)
 		return -1;
 
-	for(m_num_par = 0 ; m_num_par < MAX_PAR && len >= 2; m_num_par++)
+	m_num_set = 0;
+	m_lifetime = 0;
+	m_client_addr = 0;
+	m_station_id = m_network_id = m_vendor_var = NULL;
+	m_station_id_len = m_network_id_len = m_vendor_var_len = 0;
+	for(int num_par = 0 ; num_par < MAX_PAR && len >= 2; num_par++)
 	{
-		int res = parsePar(data, len, m_par[m_num_par]);
+		int res = parsePar(data, len, par_cnt);
 		if(res < 0)
 			return res;
 	}
 
-	if(len != 0)
+	if(len != 0 || !check(par_cnt))
 		return -1;
 	return 0;
 }
 
-bool Packet::check()
+bool PacketView::check(uint8_t *par_cnt)
 {
-	int par_cnt[(uint8_t) ParType::MAX_PARTYPE] = {0};
-	for(int num_par = 0 ; num_par < m_num_par; num_par++)
-	{
-		uint16_t val;
-		par_cnt[(uint8_t)m_par[num_par]->m_par_id]++;
-		switch(m_par[num_par]->m_par_id)
-		{
-			case ParType::STATION_ID:
-				if(!(m_control_word & STATIONID_CW))
-					return false;
-				break;
-			case ParType::MAC_ADDR_SET:
-				val = SETPROV_CW | ((MacSetPar *)(m_par[num_par]))->m_set.slapType();
-				if((m_control_word & (SETPROV_CW | SLAP_CW)) != val)
-					return false;
-				break;
-			case ParType::NETWORK_ID:
-				if(!(m_control_word & NETWORKID_CW))
-					return false;
-				break;
-			case ParType::VENDOR:
-				if(!(m_control_word & VENDOR_CW))
-					return false;
-				break;
-		}	
-	}
-	if(par_cnt[(uint8_t)ParType::MAC_ADDR_SET] > 2
-		|| par_cnt[(uint8_t)ParType::MAC_ADDR_SET] == 2 && m_message_type != MsgType::DEFEND)
+	if(par_cnt[(uint8_t)ParType::MAC_ADDR_SET] == 2 && m_message_type != MsgType::DEFEND)
 		return false;
-		
+
 	for(int i = 0; i < (uint8_t)ParType::MAX_PARTYPE; i++)
 	{
 		if(i != (uint8_t)ParType::MAC_ADDR_SET && par_cnt[i] > 1)
@@ -400,41 +464,41 @@ bool Packet::check()
 	switch(m_message_type)
 	{
 		case MsgType::DISCOVER:
-			if((m_control_word & (SERVER_CW | NETWORKID_CW | CODEFIELD_CW | RENEWAL_CW)) 
+			if((m_control_word & (SERVER_CW | NETWORKID_CW | CODEFIELD_CW | RENEWAL_CW))
 					|| par_cnt[(uint8_t)ParType::LIFETIME] > 0)
 				return false;
 			break;
 		case MsgType::OFFER:
-			if((m_control_word & (CODEFIELD_CW | RENEWAL_CW)) 
-					|| par_cnt[(uint8_t)ParType::LIFETIME] != 1 
-					|| (m_control_word & (SERVER_CW | SETPROV_CW) != (SERVER_CW | SETPROV_CW)))
+			if((m_control_word & (CODEFIELD_CW | RENEWAL_CW))
+					|| par_cnt[(uint8_t)ParType::LIFETIME] != 1
+					|| (m_control_word & (SERVER_CW | SETPROV_CW)) != (SERVER_CW | SETPROV_CW))
 				return false;
 			break;
 		case MsgType::REQUEST:
-			if((m_control_word & (SERVER_CW | NETWORKID_CW | CODEFIELD_CW)) 
+			if((m_control_word & (SERVER_CW | NETWORKID_CW | CODEFIELD_CW))
 					|| par_cnt[(uint8_t)ParType::LIFETIME] > 0
 					|| par_cnt[(uint8_t)ParType::CLIENT_ADDR] > 0
-					|| (m_control_word & (SETPROV_CW) != SETPROV_CW))
+					|| !(m_control_word & SETPROV_CW))
 				return false;
 			break;
 		case MsgType::ACK:
-			if((m_control_word & (RENEWAL_CW)) 
-					|| (m_control_word & (SERVER_CW | CODEFIELD_CW) != (SERVER_CW | CODEFIELD_CW))
+			if((m_control_word & (RENEWAL_CW))
+					|| (m_control_word & (SERVER_CW | CODEFIELD_CW)) != (SERVER_CW | CODEFIELD_CW)
 					|| par_cnt[(uint8_t)ParType::CLIENT_ADDR] > 0)
 				return false;
 			break;
 		case MsgType::RELEASE:
 			if((m_control_word & (SERVER_CW | NETWORKID_CW | CODEFIELD_CW | RENEWAL_CW))
-					|| par_cnt[(uint8_t)ParType::LIFETIME] > 0 
+					|| par_cnt[(uint8_t)ParType::LIFETIME] > 0
 					|| par_cnt[(uint8_t)ParType::CLIENT_ADDR] > 0
-					|| (m_control_word & (SETPROV_CW) != SETPROV_CW))
+					|| !(m_control_word & SETPROV_CW))
 				return false;
 			break;
 		case MsgType::DEFEND:
 			if((m_control_word & (SERVER_CW | NETWORKID_CW | CODEFIELD_CW | RENEWAL_CW))
 					|| par_cnt[(uint8_t)ParType::LIFETIME] != 1
 					|| par_cnt[(uint8_t)ParType::CLIENT_ADDR] > 0
-					|| (m_control_word & (SETPROV_CW) != SETPROV_CW)
+					|| !(m_control_word & SETPROV_CW)
 					|| par_cnt[(uint8_t)ParType::MAC_ADDR_SET] != 2)
 				return false;
 			break;
@@ -442,147 +506,97 @@ bool Packet::check()
 			if((m_control_word & (SERVER_CW | NETWORKID_CW | CODEFIELD_CW | RENEWAL_CW))
 					|| par_cnt[(uint8_t)ParType::LIFETIME] != 1
 					|| par_cnt[(uint8_t)ParType::CLIENT_ADDR] > 0
-					|| (m_control_word & (SETPROV_CW) != SETPROV_CW))
+					|| !(m_control_word & SETPROV_CW))
 				return false;
 			break;
 	}
 	return true;
 }
 
-
-int Packet::toBuffer(uint8_t *data)
-{
-	set64(m_DA, data, 6);		
-	set64(m_SA, data, 6);	
-	set16(PALMA_TYPE, data);	
-	*data++ = PALMA_SUBTYPE;
-	*data++ = (m_version << 5) | (uint8_t) m_message_type;
-	set16(m_control_word, data);
-	set16(m_token, data);
-	*data++ = ((uint8_t) m_status << 4) | (m_length >> 8);
-	*data++ = m_length & 0xFF;
-
-	int len = MIN_PKT_SIZE;
-
-	for(int m_num_par = 0 ; m_num_par < MAX_PAR && m_par[m_num_par] != NULL; m_num_par++)
-		len += m_par[m_num_par]->toBuffer(data);
-
-	return len;
-}
-
-void Packet::setSA(uint64_t addr)
+uint8_t *PacketView::getData()
 {
-	m_SA = addr;
+	return m_data;
 }
 
-void Packet::setRenewal()
+uint16_t PacketView::getFrameLen()
 {
-	m_control_word |= RENEWAL_CW;
+	return m_frame_len;
 }
 
-bool Packet::getRenewal()
+bool PacketView::getRenewal()
 {
 	return m_control_word & RENEWAL_CW;
 }
 
-MsgType Packet::getType()
+MsgType PacketView::getType()
 {
 	return m_message_type;
 }
 
-uint64_t Packet::getDA()
+uint64_t PacketView::getDA()
 {
 	return m_DA;
 }
 
-uint64_t Packet::getSA()
+uint64_t PacketView::getSA()
 {
 	return m_SA;
 }
 
-StatusCode Packet::getStatus()
+StatusCode PacketView::getStatus()
 {
 	return m_status;
 }
 
-uint16_t Packet::getToken()
+uint16_t PacketView::getToken()
 {
 	return m_token;
 }
 
-AddrSet *Packet::getSet(bool first_instance)
+AddrSet *PacketView::getSet(bool first_instance)
 {
-	if(m_control_word & SETPROV_CW)
-	{
-		for(int i = 0; i < m_num_par; i++)
-		{
-			if(m_par[i] != NULL && (m_par[i]->m_par_id == ParType::MAC_ADDR_SET))
-				if(first_instance)
-					return &(((MacSetPar *)(m_par[i]))->m_set);
-				else
-					first_instance = true;
-		}
-	}
+	int idx = first_instance ? 0 : 1;
+	if((m_control_word & SETPROV_CW) && idx < m_num_set)
+		return &m_set[idx];
 	return NULL;
 }
 
-uint64_t Packet::getClientAddr()
+uint64_t PacketView::getClientAddr()
 {
-	for(int i = 0; i < m_num_par; i++)
-	{
-		if(m_par[i] != NULL && m_par[i]->m_par_id == ParType::CLIENT_ADDR)
-			return ((ClientAddrPar *)(m_par[i]))->m_set.m_addr;
-	}
-	return 0;
+	return m_client_addr;
 }
 
-uint16_t Packet::getLifetime()
+uint16_t PacketView::getLifetime()
 {
-	for(int i = 0; i < m_num_par; i++)
-	{
-		if(m_par[i] != NULL && m_par[i]->m_par_id == ParType::LIFETIME)
-			return ((LifetimePar *)(m_par[i]))->m_lifetime;
-	}
-	return 0;
+	return m_lifetime;
 }
 
-uint8_t *Packet::getStationId()
+uint8_t *PacketView::getStationId()
 {
-	if(m_control_word & STATIONID_CW)
-	{
-		for(int i = 0; i < m_num_par; i++)
-		{
-			if(m_par[i] != NULL && m_par[i]->m_par_id == ParType::STATION_ID)
-				return ((IdPar *)(m_par[i]))->m_id;
-		}
-	}
-	return NULL;
+	return m_station_id;
 }
 
-uint8_t *Packet::getNetworkId()
+uint8_t PacketView::getStationIdLen()
 {
-	if(m_control_word & NETWORKID_CW)
-	{
-		for(int i = 0; i < m_num_par; i++)
-		{
-			if(m_par[i] != NULL && m_par[i]->m_par_id == ParType::NETWORK_ID)
-				return ((IdPar *)(m_par[i]))->m_id;
-		}
-	}
-	return NULL;
+	return m_station_id_len;
 }
 
-uint8_t *Packet::getVendorVar()
+uint8_t *PacketView::getNetworkId()
 {
-	if(m_control_word & VENDOR_CW)
-	{
-		for(int i = 0; i < m_num_par; i++)
-		{
-			if(m_par[i] != NULL && m_par[i]->m_par_id == ParType::VENDOR)
-				return ((VendorPar *)(m_par[i]))->m_var;
-		}
-	}
-	return NULL;
+	return m_network_id;
 }
 
+uint8_t PacketView::getNetworkIdLen()
+{
+	return m_network_id_len;
+}
 
+uint8_t *PacketView::getVendorVar()
+{
+	return m_vendor_var;
+}
+
+uint8_t PacketView::getVendorVarLen()
+{
+	return m_vendor_var_len;
+}
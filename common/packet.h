@@ -21,6 +21,9 @@ enum class MsgType : uint8_t
 	ANNOUNCE		= 7, 
 };
 
+#define MSG_BIT(type)	(1 << (uint8_t)(type))
+#define ALL_MSG_TYPES	0xffffffff
+
 enum class ParType : uint8_t
 {
 	STATION_ID		= 1,
@@ -52,7 +55,6 @@ public:
 	PacketPar(ParType par_id, uint8_t len);
 	virtual ~PacketPar() {};
 	virtual int toBuffer(uint8_t *&data);
-	virtual PacketPar* clone() = 0;
 };
 
 class IdPar : public PacketPar
@@ -63,7 +65,6 @@ public:
 	IdPar(ParType par_id, uint8_t *data, uint8_t len);	
 	~IdPar();
 	int toBuffer(uint8_t *&data);
-	PacketPar* clone();
 };
 
 class MacSetPar : public PacketPar
@@ -71,12 +72,10 @@ class MacSetPar : public PacketPar
 public:
 	AddrSet m_set;
 
-	MacSetPar(uint8_t *data, uint8_t len);
 	MacSetPar(AddrSet &set);
 	~MacSetPar() {}
 	int toBuffer(uint8_t *&data);	
-	uint8_t length(AddrSet &set);
-	PacketPar* clone();
+	static uint8_t length(AddrSet &set);
 };
 
 
@@ -85,11 +84,9 @@ class LifetimePar : public PacketPar
 public:
 	uint16_t m_lifetime;
 
-	LifetimePar(uint8_t *data, uint8_t len);
 	LifetimePar(uint16_t lifetime);
 	~LifetimePar() {}
 	int toBuffer(uint8_t *&data);
-	PacketPar* clone();
 };
 
 class ClientAddrPar : public PacketPar
@@ -97,11 +94,9 @@ class ClientAddrPar : public PacketPar
 public:
 	AddrSet m_set;
 
-	ClientAddrPar(uint8_t *data, uint8_t len);
 	ClientAddrPar(AddrSet &set);
 	~ClientAddrPar() {}
 	int toBuffer(uint8_t *&data);
-	PacketPar* clone();
 };
 
 class VendorPar : public PacketPar
@@ -112,7 +107,6 @@ public:
 	VendorPar(uint8_t *data, uint8_t var_len);	
 	~VendorPar();
 	int toBuffer(uint8_t *&data);
-	PacketPar* clone();
 };
 
 class Packet
@@ -130,26 +124,88 @@ class Packet
 
 public:
 
-	Packet();
-	Packet(Packet *pkt);
 	Packet(MsgType type, uint64_t DA, uint64_t SA, uint16_t token, StatusCode status = StatusCode::NO_CODE);
 	~Packet();
 	int addPar(PacketPar *par);
 	int addIdPar(ParType par_id, uint8_t *id);
+	int addIdPar(ParType par_id, uint8_t *id, uint8_t len);
 	int addMacSetPar(AddrSet *set, bool update_cw = true);
 	int addLifetimePar(uint16_t lifetime);
 	int addVendorPar(uint8_t *var, uint8_t var_len);
 	int addClientAddrPar(AddrSet *set);
-	int parsePar(uint8_t *&data, int &len, PacketPar *&Par);
 	static uint64_t get64(uint8_t *&p, uint8_t nbytes = 8);
 	static void set64(uint64_t val, uint8_t *&p,  uint8_t nbytes = 8);
 	static uint16_t get16(uint8_t *&p);
 	static void set16(uint16_t val, uint8_t *&p);
-	int parse(uint8_t *data, int len);
-	bool check();
 	int toBuffer(uint8_t *data);
 	void setSA(uint64_t addr);
 	void setRenewal();
+};
+
+/*
+ * Prebuilt response. The header, SA and the constant parameters
+ * (NetworkId, Vendor) are serialized once, right after the header; fill()
+ * only patches DA, control word, token, status and length and appends the
+ * per-response parameters: Lifetime and MacSet when a set is given,
+ * StationId and ClientAddr.
+ */
+
+class PacketTemplate
+{
+	uint8_t m_buf[MAX_PKT_SIZE];
+	uint16_t m_control_word;
+	int m_fixed_len;
+
+	void addConstPar(ParType par_id, uint8_t *data, uint8_t len);
+
+public:
+	PacketTemplate();
+	void init(MsgType type, uint64_t SA);
+	void addIdPar(ParType par_id, uint8_t *id);
+	void addVendorPar(uint8_t *var, uint8_t var_len);
+	int fill(uint64_t DA, uint16_t token, StatusCode status, AddrSet *set, uint16_t lifetime, 
+				uint8_t *station_id, uint8_t station_id_len, AddrSet *client_addr = NULL);
+	uint8_t *getData();
+};
+
+/*
+ * Received frame. parse() validates the whole frame once and decodes the
+ * parameters inline; identifiers and vendor data are not copied and point
+ * into the frame, which must outlive the view. Identifiers are therefore
+ * not NUL terminated and come with their length.
+ */
+
+class PacketView
+{
+	uint8_t *m_data;
+	uint16_t m_frame_len;
+	uint64_t m_DA;
+	uint64_t m_SA;
+	uint8_t m_version;
+	MsgType m_message_type;
+	uint16_t m_control_word;
+	uint16_t m_token;
+	StatusCode m_status;
+	uint16_t m_length;
+	uint8_t m_num_set;
+	AddrSet m_set[2];
+	uint16_t m_lifetime;
+	uint64_t m_client_addr;
+	uint8_t *m_station_id;
+	uint8_t m_station_id_len;
+	uint8_t *m_network_id;
+	uint8_t m_network_id_len;
+	uint8_t *m_vendor_var;
+	uint8_t m_vendor_var_len;
+
+	int parsePar(uint8_t *&data, int &len, uint8_t *par_cnt);
+	bool check(uint8_t *par_cnt);
+
+public:
+	PacketView();
+	int parse(uint8_t *data, int len);
+	uint8_t *getData();
+	uint16_t getFrameLen();
 	bool getRenewal();
 	MsgType getType();
 	uint64_t getDA();
@@ -160,8 +216,11 @@ public:
 	uint64_t getClientAddr();
 	uint16_t getLifetime();
 	uint8_t *getStationId();
+	uint8_t getStationIdLen();
 	uint8_t *getNetworkId();
+	uint8_t getNetworkIdLen();
 	uint8_t *getVendorVar();
+	uint8_t getVendorVarLen();
 };
 
 #endif
@@ -12,7 +12,13 @@ public:
 	EventLoop m_event_loop;
 
 	Palma()	:	m_netitf(this) {}
-	virtual void handlePacket(Packet *pkt) {}
+	virtual void handlePacket(PacketView *pkt) {}
+
+	virtual void handleBatch(PacketView **pkts, int n)
+	{
+		for(int i = 0; i < n; i++)
+			handlePacket(pkts[i]);
+	}
 	
 	virtual void onExit() {}
 	
@@ -0,0 +1,58 @@
+#include <string.h>
+#include "policy.h"
+#include "database.h"
+
+AllocPolicy *AllocPolicy::create(const char *name)
+{
+	if(name == NULL)
+		return NULL;
+	if(!strcmp(name, "first-fit"))
+		return new FirstFit();
+	if(!strcmp(name, "best-fit"))
+		return new BestFit();
+	if(!strcmp(name, "worst-fit"))
+		return new WorstFit();
+	if(!strcmp(name, "aligned-fit"))
+		return new AlignedFit();
+	if(!strcmp(name, "next-fit"))
+		return new NextFit();
+	return NULL;
+}
+
+AssignableSet *FirstFit::pick(SetDatabase *db, uint64_t size)
+{
+	return db->m_root->findFree(size);
+}
+
+AssignableSet *BestFit::pick(SetDatabase *db, uint64_t size)
+{
+	return db->m_root->findBest(size, NULL);
+}
+
+AssignableSet *WorstFit::pick(SetDatabase *db, uint64_t size)
+{
+	return db->m_root->findFree(db->m_root->m_max_free);
+}
+
+/* Free sizes above 0xffff are already those of the aligned blocks. */
+
+AssignableSet *AlignedFit::pick(SetDatabase *db, uint64_t size)
+{
+	AssignableSet *set = NULL;
+	if(size > 1 && size <= 0xffff)
+		set = db->m_root->findAligned((uint64_t) 1 << (64 - __builtin_clzll(size - 1)));
+	if(set == NULL)
+		set = db->m_root->findFree(size);
+	return set;
+}
+
+NextFit::NextFit() : m_cursor(0) {}
+
+AssignableSet *NextFit::pick(SetDatabase *db, uint64_t size)
+{
+	AssignableSet *set = db->m_root->findFreeFrom(m_cursor, size);
+	if(set == NULL)
+		set = db->m_root->findFree(size);
+	m_cursor = set->getFirstAddr();
+	return set;
+}
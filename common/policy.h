@@ -0,0 +1,77 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <stdint.h>
+
+class SetDatabase;
+class AssignableSet;
+
+/*
+ * Chooses the free set of a SetDatabase a new lease is carved from. The
+ * size asked for is already cut down to the largest free set, so there is
+ * always one that fits. Policies that keep state (next-fit) are meant to
+ * be used by a single database.
+ */
+
+class AllocPolicy
+{
+public:
+	virtual const char *name() = 0;
+	virtual AssignableSet *pick(SetDatabase *db, uint64_t size) = 0;
+	virtual bool aligned() {return false;}
+	virtual ~AllocPolicy() {}
+
+	static AllocPolicy *create(const char *name);
+};
+
+/* Lowest free set that fits. The default of SetDatabase. */
+
+class FirstFit : public AllocPolicy
+{
+public:
+	const char *name() {return "first-fit";}
+	AssignableSet *pick(SetDatabase *db, uint64_t size);
+};
+
+/* Smallest free set that fits, the lowest one on ties. */
+
+class BestFit : public AllocPolicy
+{
+public:
+	const char *name() {return "best-fit";}
+	AssignableSet *pick(SetDatabase *db, uint64_t size);
+};
+
+/* Largest free set. */
+
+class WorstFit : public AllocPolicy
+{
+public:
+	const char *name() {return "worst-fit";}
+	AssignableSet *pick(SetDatabase *db, uint64_t size);
+};
+
+/* Lowest free set holding a block aligned to the size rounded up to a
+   power of 2, which the lease is placed at. */
+
+class AlignedFit : public AllocPolicy
+{
+public:
+	const char *name() {return "aligned-fit";}
+	AssignableSet *pick(SetDatabase *db, uint64_t size);
+	bool aligned() {return true;}
+};
+
+/* First free set that fits from the last one picked on, wrapping around
+   at the end of the pool. */
+
+class NextFit : public AllocPolicy
+{
+	uint64_t m_cursor;
+public:
+	NextFit();
+	const char *name() {return "next-fit";}
+	AssignableSet *pick(SetDatabase *db, uint64_t size);
+};
+
+#endif
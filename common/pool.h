@@ -0,0 +1,131 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+#include <sys/mman.h>
+
+#define POOL_SLAB_SIZE		(1 << 16)
+#define POOL_HUGE_SLAB_SIZE	(1 << 21)
+
+/*
+ * Fixed-size object pool. Objects are carved from slabs mapped with mmap
+ * and recycled through a free list threaded through the unused slots, so
+ * that objects of one pool stay packed together. With huge pages enabled
+ * slabs are 2 MB and mapped with MAP_HUGETLB, falling back to transparent
+ * huge pages when none are reserved. Slabs are only returned to the
+ * system when the pool is destroyed.
+ */
+
+template <class T>
+class ObjectPool
+{
+	union Slot
+	{
+		Slot *m_next;
+		alignas(T) uint8_t m_obj[sizeof(T)];
+	};
+
+	struct Slab
+	{
+		Slab *m_next;
+		size_t m_size;
+	};
+
+	Slot *m_free;
+	Slab *m_slab_list;
+	bool m_huge;
+
+	void grow()
+	{
+		size_t size = m_huge ? POOL_HUGE_SLAB_SIZE : POOL_SLAB_SIZE;
+		void *mem = MAP_FAILED;
+		if(m_huge)
+		{
+			mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if(mem != MAP_FAILED)
+				m_hugetlb_slabs++;
+		}
+		if(mem == MAP_FAILED)
+		{
+			mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if(mem == MAP_FAILED)
+			{
+				perror("Mapping pool slab");
+				exit(1);
+			}
+			if(m_huge)
+				madvise(mem, size, MADV_HUGEPAGE);
+		}
+		Slab *slab = (Slab *) mem;
+		slab->m_next = m_slab_list;
+		slab->m_size = size;
+		m_slab_list = slab;
+		m_slabs++;
+
+		uintptr_t first = ((uintptr_t) (slab + 1) + alignof(Slot) - 1) & ~(uintptr_t)(alignof(Slot) - 1);
+		Slot *slot = (Slot *) first;
+		int count = ((uintptr_t) mem + size - first) / sizeof(Slot);
+		for(int i = count - 1; i >= 0; i--)
+		{
+			slot[i].m_next = m_free;
+			m_free = &slot[i];
+		}
+		m_capacity += count;
+	}
+
+public:
+	uint64_t m_slabs;
+	uint64_t m_hugetlb_slabs;
+	uint64_t m_capacity;
+	uint64_t m_in_use;
+	uint64_t m_peak;
+	uint64_t m_allocs;
+
+	ObjectPool() : m_free(NULL), m_slab_list(NULL), m_huge(false), m_slabs(0), m_hugetlb_slabs(0),
+					m_capacity(0), m_in_use(0), m_peak(0), m_allocs(0) {}
+
+	~ObjectPool()
+	{
+		while(m_slab_list != NULL)
+		{
+			Slab *slab = m_slab_list;
+			m_slab_list = slab->m_next;
+			munmap(slab, slab->m_size);
+		}
+	}
+
+	/* Only affects slabs mapped afterwards. */
+	void setHugePages(bool huge)
+	{
+		m_huge = huge;
+	}
+
+	template <class... Args>
+	T *create(Args... args)
+	{
+		if(m_free == NULL)
+			grow();
+		Slot *slot = m_free;
+		m_free = slot->m_next;
+		m_allocs++;
+		if(++m_in_use > m_peak)
+			m_peak = m_in_use;
+		return new (slot->m_obj) T(args...);
+	}
+
+	void destroy(T *obj)
+	{
+		if(obj == NULL)
+			return;
+		obj->~T();
+		Slot *slot = (Slot *) obj;
+		slot->m_next = m_free;
+		m_free = slot;
+		m_in_use--;
+	}
+};
+
+#endif
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "segment.h"
+
+#define MIN_SEGMENT_BUCKETS		64
+#define MIN_SEGMENT_FRAMES		64
+
+Segment::Segment(EventLoop *loop, double latency, double loss) : m_loop(loop),
+																m_latency(latency),
+																m_loss(loss),
+																m_uplink(NULL),
+																m_local(true),
+																m_table(NULL),
+																m_table_size(0),
+																m_members(0),
+																m_frames(NULL),
+																m_frames_size(0),
+																m_head(0),
+																m_tail(0),
+																m_targets(NULL),
+																m_targets_size(0),
+																m_sent(0),
+																m_delivered(0),
+																m_dropped(0)
+{
+	growTable();
+}
+
+Segment::~Segment()
+{
+	m_loop->stopTimer(this);
+	free(m_table);
+	free(m_frames);
+	free(m_targets);
+}
+
+uint64_t Segment::bucket(uint64_t addr)
+{
+	return (addr * 0x9e3779b97f4a7c15) & (m_table_size - 1);
+}
+
+void Segment::growTable()
+{
+	SegmentMember **old = m_table;
+	uint64_t old_size = m_table_size;
+	m_table_size = old_size ? 2 * old_size : MIN_SEGMENT_BUCKETS;
+	m_table = (SegmentMember **) calloc(m_table_size, sizeof(SegmentMember *));
+	if(m_table == NULL)
+	{
+		perror("Growing segment table");
+		exit(1);
+	}
+	for(uint64_t i = 0; i < old_size; i++)
+	{
+		SegmentMember *m = old[i];
+		while(m != NULL)
+		{
+			SegmentMember *next = m->m_next;
+			uint64_t b = bucket(m->m_addr);
+			m->m_next = m_table[b];
+			m_table[b] = m;
+			m = next;
+		}
+	}
+	free(old);
+}
+
+void Segment::growFrames()
+{
+	uint64_t size = m_frames_size ? 2 * m_frames_size : MIN_SEGMENT_FRAMES;
+	SegmentFrame *frames = (SegmentFrame *) malloc(size * sizeof(SegmentFrame));
+	if(frames == NULL)
+	{
+		perror("Growing segment queue");
+		exit(1);
+	}
+	for(uint64_t i = m_head; i != m_tail; i++)
+		frames[i - m_head] = m_frames[i & (m_frames_size - 1)];
+	free(m_frames);
+	m_frames = frames;
+	m_frames_size = size;
+	m_tail -= m_head;
+	m_head = 0;
+}
+
+void Segment::setUplink(NetItf *itf, bool local)
+{
+	m_uplink = itf;
+	m_local = local;
+}
+
+/* Frames from the link are delivered at once, they already took their
+   time to arrive. */
+
+void Segment::inject(uint8_t *data, int len)
+{
+	if(len < 6)
+		return;
+	deliver(NULL, data, len);
+}
+
+void Segment::join(NetItf *itf, uint64_t addr)
+{
+	if(m_members == m_table_size)
+		growTable();
+	uint64_t b = bucket(addr);
+	m_table[b] = m_member_pool.create(addr, itf, m_table[b]);
+	m_members++;
+}
+
+void Segment::leave(NetItf *itf, uint64_t addr)
+{
+	for(SegmentMember **p = &m_table[bucket(addr)]; *p != NULL; p = &(*p)->m_next)
+	{
+		SegmentMember *m = *p;
+		if(m->m_addr == addr && m->m_itf == itf)
+		{
+			*p = m->m_next;
+			m_member_pool.destroy(m);
+			m_members--;
+			return;
+		}
+	}
+}
+
+void Segment::send(NetItf *itf, uint8_t *data, int len)
+{
+	m_sent++;
+	if(m_loss > 0 && drand48() < m_loss)
+	{
+		m_dropped++;
+		return;
+	}
+	if(m_uplink != NULL)
+	{
+		m_uplink->netsend(data, len);
+		if(!m_local)
+			return;
+	}
+	if(m_tail - m_head == m_frames_size)
+		growFrames();
+	SegmentFrame *f = &m_frames[m_tail++ & (m_frames_size - 1)];
+	f->m_time = Clock::read() + m_latency;
+	f->m_src = itf;
+	f->m_len = len;
+	memcpy(f->m_data, data, len);
+	if(!active)
+		schedule(f->m_time - m_latency);
+}
+
+void Segment::schedule(double now)
+{
+	double wait = m_frames[m_head & (m_frames_size - 1)].m_time - now;
+	set(wait > 0 ? wait : 0.);
+	m_loop->startTimer(this);
+}
+
+/* The receivers are collected first, since handling a frame may add or
+   drop addresses of the segment. */
+
+void Segment::deliver(NetItf *src, uint8_t *data, int len)
+{
+	uint64_t addr = 0, n = 0;
+	for(int i = 0; i < 6; i++)
+		addr = (addr << 8) | data[i];
+	for(SegmentMember *m = m_table[bucket(addr)]; m != NULL; m = m->m_next)
+	{
+		if(m->m_addr != addr || m->m_itf == src)
+			continue;
+		if(n == m_targets_size)
+		{
+			m_targets_size = m_targets_size ? 2 * m_targets_size : 16;
+			m_targets = (NetItf **) realloc(m_targets, m_targets_size * sizeof(NetItf *));
+			if(m_targets == NULL)
+			{
+				perror("Growing segment targets");
+				exit(1);
+			}
+		}
+		m_targets[n++] = m->m_itf;
+	}
+	for(uint64_t i = 0; i < n; i++)
+	{
+		if(m_targets[i]->accepts(data, len))
+		{
+			m_targets[i]->receive(data, len);
+			m_delivered++;
+		}
+	}
+}
+
+/* Only the frames already due are delivered, the ones sent meanwhile wait
+   for the next round even without latency. They are counted rather than
+   marked by index, since a frame sent from deliver() may grow the queue
+   and move them. */
+
+void Segment::timeout()
+{
+	double now = Clock::read();
+	uint64_t pending = m_tail - m_head;
+	while(pending > 0 && m_frames[m_head & (m_frames_size - 1)].m_time <= now)
+	{
+		pending--;
+		SegmentFrame *f = &m_frames[m_head++ & (m_frames_size - 1)];
+		NetItf *src = f->m_src;
+		int len = f->m_len;
+		memcpy(m_rxbuf, f->m_data, len);
+		deliver(src, m_rxbuf, len);
+	}
+	if(m_head != m_tail)
+		schedule(now);
+}
@@ -0,0 +1,81 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include <stdint.h>
+#include "netitf.h"
+#include "eventloop.h"
+#include "packet.h"
+#include "pool.h"
+
+struct SegmentFrame
+{
+	double m_time;
+	NetItf *m_src;
+	int m_len;
+	uint8_t m_data[MAX_PKT_SIZE];
+};
+
+struct SegmentMember
+{
+	uint64_t m_addr;
+	NetItf *m_itf;
+	SegmentMember *m_next;
+
+	SegmentMember(uint64_t addr, NetItf *itf, SegmentMember *next) : m_addr(addr), m_itf(itf), m_next(next) {}
+};
+
+/*
+ * In-memory Ethernet segment joining the NetItfs of protocol instances
+ * that live in the same process. A frame reaches every other interface
+ * that added its destination address, with the same checks as the socket
+ * filter, once the latency of the segment has passed. Deliveries run from
+ * a timer of the given event loop, so with a Simulator whole exchanges
+ * happen in virtual time. A fraction of the frames can be dropped at
+ * random. With an uplink, the segment is also bridged to a real link:
+ * frames sent on it go out through the uplink, and frames the uplink
+ * receives are injected back to the members they are addressed to.
+ * Members can be kept from hearing each other, so that all they exchange
+ * goes through the link.
+ */
+
+class Segment : public Transport, public Timer
+{
+	EventLoop *m_loop;
+	double m_latency;
+	double m_loss;
+	NetItf *m_uplink;
+	bool m_local;
+	SegmentMember **m_table;
+	uint64_t m_table_size;
+	uint64_t m_members;
+	ObjectPool<SegmentMember> m_member_pool;
+	SegmentFrame *m_frames;
+	uint64_t m_frames_size;
+	uint64_t m_head;
+	uint64_t m_tail;
+	NetItf **m_targets;
+	uint64_t m_targets_size;
+	uint8_t m_rxbuf[MAX_PKT_SIZE];
+
+	uint64_t bucket(uint64_t addr);
+	void growTable();
+	void growFrames();
+	void deliver(NetItf *src, uint8_t *data, int len);
+	void schedule(double now);
+
+public:
+	uint64_t m_sent;
+	uint64_t m_delivered;
+	uint64_t m_dropped;
+
+	Segment(EventLoop *loop, double latency = 0., double loss = 0.);
+	~Segment();
+	void setUplink(NetItf *itf, bool local = true);
+	void inject(uint8_t *data, int len);
+	void join(NetItf *itf, uint64_t addr);
+	void leave(NetItf *itf, uint64_t addr);
+	void send(NetItf *itf, uint8_t *data, int len);
+	void timeout();
+};
+
+#endif
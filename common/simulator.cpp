@@ -0,0 +1,56 @@
+#include <stdlib.h>
+#include "simulator.h"
+
+Simulator::Simulator(long seed, double start) : m_clock(start), m_steps(0)
+{
+	srand48(seed);
+	Clock::install(&m_clock);
+}
+
+Simulator::~Simulator()
+{
+	Clock::install(NULL);
+}
+
+void Simulator::attach(EventLoop *loop)
+{
+	loop->setTimerList(&m_timers);
+}
+
+void Simulator::detach(EventLoop *loop)
+{
+	loop->setTimerList(NULL);
+}
+
+double Simulator::now()
+{
+	return m_clock.now();
+}
+
+/* Moves the clock to the first timer and fires all those due then.
+   Returns false when there is nothing left to run. */
+
+bool Simulator::step()
+{
+	double expire;
+	Time wait;
+
+	if(EventLoop::m_finalize || !m_timers.next(expire))
+		return false;
+	if(expire > m_clock.now())
+		m_clock.set(expire);
+	m_timers.check(&wait);
+	m_steps++;
+	return true;
+}
+
+void Simulator::run(double duration)
+{
+	double end = m_clock.now() + duration;
+	double expire;
+
+	while(m_timers.next(expire) && expire <= end && step())
+		;
+	if(end > m_clock.now())
+		m_clock.set(end);
+}
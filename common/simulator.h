@@ -0,0 +1,34 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <stdint.h>
+#include "timer.h"
+#include "eventloop.h"
+
+/*
+ * Discrete-event simulation of any number of protocol instances in one
+ * process. The event loops attached share a single timer list, run on a
+ * virtual clock installed for the lifetime of the simulator, and time
+ * jumps straight to the next timer instead of being waited for. Runs are
+ * reproducible: the random generator is seeded at construction and the
+ * timers due at the same time always fire in the same order.
+ */
+
+class Simulator
+{
+	VirtualClock m_clock;
+	TimerList m_timers;
+
+public:
+	uint64_t m_steps;
+
+	Simulator(long seed, double start = 0.);
+	~Simulator();
+	void attach(EventLoop *loop);
+	void detach(EventLoop *loop);
+	double now();
+	bool step();
+	void run(double duration);
+};
+
+#endif
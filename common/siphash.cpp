@@ -36,6 +36,18 @@ SipHash::SipHash()
 	m_k1 = lrand48() ^ ((uint64_t)lrand48() << 32);
 }
 
+void SipHash::getKey(uint64_t &k0, uint64_t &k1)
+{
+	k0 = m_k0;
+	k1 = m_k1;
+}
+
+void SipHash::setKey(uint64_t k0, uint64_t k1)
+{
+	m_k0 = k0;
+	m_k1 = k1;
+}
+
 void SipHash::begin()
 {
 	m_v0 = (0x736f6d6570736575 ^ m_k0);
@@ -68,6 +80,14 @@ void SipHash::update(uint8_t *data)
 	}
 }
 
+void SipHash::update(uint8_t *data, int len) 
+{
+	while (data != NULL && len-- > 0) 
+	{
+			update(*data++);
+	}
+}
+
 void SipHash::update(uint16_t data)
 {
 	update((uint8_t)(data & 0xff));
@@ -11,9 +11,12 @@ private:
 		uint8_t m_input_len;
 public:
 		SipHash();
+		void getKey(uint64_t &k0, uint64_t &k1);
+		void setKey(uint64_t k0, uint64_t k1);
 		void begin();
 		void update(uint8_t data);
 		void update(uint8_t *data);
+		void update(uint8_t *data, int len);
 		void update(uint16_t data);
 		void update(uint64_t data);
 	  	uint64_t digest();
@@ -0,0 +1,90 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SNAPSHOT_MAGIC		"PALMASNP"
+#define SNAPSHOT_VERSION	3
+#define SNAPSHOT_MAX_DBS	4
+
+/*
+ * On-disk snapshot of the leases of one or more SetDatabases. The layout
+ * is fixed so that the file can be mapped and used in place: the header
+ * is followed, for each database, by an array with its leases sorted by
+ * address. Free intervals are the gaps between leases. Expiry times are
+ * absolute wall clock seconds.
+ */
+
+struct SnapshotLease
+{
+	uint64_t m_first;
+	uint64_t m_count;
+	uint64_t m_security_id;
+	double m_expire;
+	uint8_t m_reserved;
+	uint8_t m_pad[7];
+};
+
+struct SnapshotDb
+{
+	uint64_t m_first;		/* whole set of the database */
+	uint64_t m_count;
+	uint64_t m_offset;		/* of its leases, from the start of the file */
+	uint64_t m_leases;
+};
+
+struct SnapshotHeader
+{
+	char m_magic[8];
+	uint32_t m_version;
+	uint32_t m_ndbs;
+	uint64_t m_seq;
+	double m_time;
+	uint64_t m_key[2];
+	SnapshotDb m_db[SNAPSHOT_MAX_DBS];
+	uint64_t m_size;
+	uint64_t m_check;
+};
+
+/* Only meant to catch torn or corrupted writes, so a plain word hash. */
+
+static inline uint64_t snapshotChecksum(const void *buf, size_t len, uint64_t h = 0xcbf29ce484222325)
+{
+	const uint64_t *w = (const uint64_t *) buf;
+	for(size_t i = 0; i < len / sizeof(uint64_t); i++)
+	{
+		h = (h ^ w[i]) * 0x100000001b3;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+/* Covers the whole image but m_check, the last field of the header. */
+
+static inline uint64_t snapshotImageChecksum(const uint8_t *buf, size_t len)
+{
+	uint64_t h = snapshotChecksum(buf, offsetof(SnapshotHeader, m_check));
+	return snapshotChecksum(buf + sizeof(SnapshotHeader), len - sizeof(SnapshotHeader), h);
+}
+
+/* Checks a whole snapshot image before any of its leases is used. */
+
+static inline bool snapshotValid(const uint8_t *buf, size_t len)
+{
+	const SnapshotHeader *h = (const SnapshotHeader *) buf;
+	if(len < sizeof(SnapshotHeader) || memcmp(h->m_magic, SNAPSHOT_MAGIC, sizeof(h->m_magic)) != 0
+		|| h->m_version != SNAPSHOT_VERSION || h->m_ndbs > SNAPSHOT_MAX_DBS || h->m_size != len)
+		return false;
+	for(uint32_t i = 0; i < h->m_ndbs; i++)
+	{
+		const SnapshotDb *db = &h->m_db[i];
+		if(db->m_offset < sizeof(SnapshotHeader) || db->m_offset > len
+			|| db->m_leases > (len - db->m_offset) / sizeof(SnapshotLease))
+			return false;
+	}
+	return snapshotImageChecksum(buf, len) == h->m_check;
+}
+
+#endif
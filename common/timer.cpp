@@ -1,11 +1,44 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "timer.h"
 #define NSPERS	(1000000000UL)
 
+Clock *Clock::m_current = NULL;
+
+void Clock::install(Clock *clock)
+{
+	m_current = clock;
+}
+
+double Clock::read()
+{
+	if(m_current != NULL)
+		return m_current->now();
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+VirtualClock::VirtualClock(double start) : m_now(start) {}
+
+void VirtualClock::set(double t)
+{
+	m_now = t;
+}
+
+void VirtualClock::advance(double d)
+{
+	if(d > 0)
+		m_now += d;
+}
+
 Time::Time()
 {
-	clock_gettime(CLOCK_MONOTONIC, this);
+	if(Clock::m_current != NULL)
+		set(Clock::m_current->now());
+	else
+		clock_gettime(CLOCK_MONOTONIC, this);
 }
 
 void Time::normalize()
@@ -54,105 +87,225 @@ void Time::set(double d)
 	tv_nsec = (long)((d - sec) * 1e9);
 }
 
-Timer::Timer(double t) : m_duration(t), m_next(NULL), active(false) {}
+Timer::Timer(double t) : m_duration(t), m_expire(0.), m_index(-1), active(false) {}
 
 void Timer::set(double t)
 {
 	m_duration = t;
 }
 
-TimerList::TimerList() : m_first()
+TimerList::TimerList() : m_heap(NULL), m_count(0), m_size(0), m_due(NULL), m_due_count(0), m_due_size(0) {}
+
+TimerList::~TimerList()
 {
-	refresh();
+	free(m_heap);
+	free(m_due);
 }
 
-void TimerList::refresh()
+void TimerList::grow(int count)
 {
-	Time now;
-	if(m_first.m_next != NULL)
-		m_first.m_next->m_duration -= now.elapsed(m_ref);
-	m_ref = now;
+	if(count <= m_size)
+		return;
+	while(m_size < count)
+		m_size = m_size ? 2 * m_size : 64;
+	m_heap = (Timer **) realloc(m_heap, m_size * sizeof(Timer *));
+	if(m_heap == NULL)
+	{
+		perror("Growing timer list");
+		exit(1);
+	}
 }
 
-double TimerList::read(Timer *timer)
+void TimerList::place(Timer *timer, int index)
 {
-	if(!timer->active)
-		return 0.;
+	m_heap[index] = timer;
+	timer->m_index = index;
+}
 
-	double time = 0.;
-	refresh();
+void TimerList::siftUp(int index)
+{
+	Timer *timer = m_heap[index];
+	while(index > 0)
+	{
+		int parent = (index - 1) / 2;
+		if(m_heap[parent]->m_expire <= timer->m_expire)
+			break;
+		place(m_heap[parent], index);
+		index = parent;
+	}
+	place(timer, index);
+}
 
-	for(Timer *p = m_first.m_next; p != timer && p != NULL; p = p->m_next)
+void TimerList::siftDown(int index)
+{
+	Timer *timer = m_heap[index];
+	for(;;)
 	{
-		time += p->m_duration;
+		int child = 2 * index + 1;
+		if(child >= m_count)
+			break;
+		if(child + 1 < m_count && m_heap[child + 1]->m_expire < m_heap[child]->m_expire)
+			child++;
+		if(timer->m_expire <= m_heap[child]->m_expire)
+			break;
+		place(m_heap[child], index);
+		index = child;
 	}
-	time += timer->m_duration;
-	return time;
+	place(timer, index);
+}
+
+void TimerList::remove(int index)
+{
+	Timer *timer = m_heap[index];
+	timer->active = false;
+	timer->m_index = -1;
+	if(--m_count == index)
+		return;
+	place(m_heap[m_count], index);
+	if(index > 0 && m_heap[index]->m_expire < m_heap[(index - 1) / 2]->m_expire)
+		siftUp(index);
+	else
+		siftDown(index);
+}
+
+double TimerList::read(Timer *timer)
+{
+	if(!timer->active)
+		return 0.;
+
+	return timer->m_expire - Clock::read();
 }
 
 void TimerList::add(Timer *newtimer)
 {
-	refresh();
+	double now = Clock::read();
 
+	if(newtimer->active)
+		remove(newtimer->m_index);
+	grow(m_count + 1);
 	newtimer->active = true;
-	for(Timer *p = &m_first;; p = p->m_next)
+	newtimer->m_expire = now + newtimer->m_duration;
+	place(newtimer, m_count++);
+	siftUp(newtimer->m_index);
+}
+
+/* Starts n timers with their own durations. Unless they are few compared
+   to the timers already running, the heap is rebuilt bottom-up once
+   instead of sifting every new timer up. */
+
+void TimerList::addAll(Timer **timers, int n)
+{
+	double t = Clock::read();
+
+	for(int i = 0; i < n; i++)
+		if(timers[i]->active)
+			remove(timers[i]->m_index);
+	int old_count = m_count;
+	grow(m_count + n);
+	for(int i = 0; i < n; i++)
 	{
-		if(p->m_next == NULL)
-		{
-			p->m_next = newtimer;	
-			newtimer->m_next = NULL;
-			return;
-		}
-		else if(newtimer->m_duration < p->m_next->m_duration)
-		{
-			p->m_next->m_duration -= newtimer->m_duration;  
-			newtimer->m_next = p->m_next;
-			p->m_next = newtimer;
-			return;	
-		}
-		else
-			newtimer->m_duration -= p->m_next->m_duration;
+		timers[i]->active = true;
+		timers[i]->m_expire = t + timers[i]->m_duration;
+		place(timers[i], m_count++);
+	}
+	if(n < old_count / 8)
+	{
+		for(int i = old_count; i < m_count; i++)
+			siftUp(i);
+		return;
 	}
+	for(int i = m_count / 2 - 1; i >= 0; i--)
+		siftDown(i);
 }
 
 void TimerList::del(Timer *timer)
 {
-	Timer *p;
-	double left = 0.;
-
 	if(!timer->active)
 		return;
-	refresh();
-	for(p = &m_first; p->m_next != timer; p = p->m_next)
+
+	timer->m_duration = timer->m_expire - Clock::read();
+	remove(timer->m_index);
+}
+
+void TimerList::defer(Timer *timer)
+{
+	if(m_due_count == m_due_size)
 	{
-		if(p->m_next == NULL) return;
-		left += p->m_next->m_duration;
+		m_due_size = m_due_size ? 2 * m_due_size : 64;
+		m_due = (Timer **) realloc(m_due, m_due_size * sizeof(Timer *));
+		if(m_due == NULL)
+		{
+			perror("Growing timer list");
+			exit(1);
+		}
 	}
-	if(timer->m_next != NULL)
-		timer->m_next->m_duration += timer->m_duration;
-	p->m_next = timer->m_next;
-	timer->active = false;
-	timer->m_duration += left;
+	m_due[m_due_count++] = timer;
 }
 
-Time* TimerList::check(Time *t)
+/* Hands the deferred timers to their groups, one group at a time. */
+
+void TimerList::flush()
 {
-	if(m_first.m_next == NULL)
-		return NULL;
-	refresh();
+	while(m_due_count > 0)
+	{
+		TimerGroup *group = m_due[0]->group();
+		int n = 0;
+		for(int i = 0; i < m_due_count; i++)
+		{
+			if(m_due[i]->group() == group)
+			{
+				Timer *p = m_due[i];
+				m_due[i] = m_due[n];
+				m_due[n++] = p;
+			}
+		}
+		group->expire(m_due, n);
+		m_due_count -= n;
+		memmove(m_due, m_due + n, m_due_count * sizeof(Timer *));
+	}
+}
 
-	while(m_first.m_next != NULL && m_first.m_next->m_duration <= 0)
+/* Expiration time of the first timer, if any is running. */
+
+bool TimerList::next(double &expire)
+{
+	if(m_count == 0)
+		return false;
+	expire = m_heap[0]->m_expire;
+	return true;
+}
+
+/* Timers of a group are put aside while the due ones are taken from the
+   heap, and handed over before any other timer fires, so that a timeout
+   never sees a timer already taken but not yet expired. */
+
+Time* TimerList::check(Time *t)
+{
+	double now = Clock::read();
+	for(;;)
 	{
-		Timer *p = m_first.m_next;
-		p->active = false;
-		if(p->m_next != NULL)
-			p->m_next->m_duration += p->m_duration;
-		m_first.m_next = m_first.m_next->m_next;
-		p->timeout();
-		refresh();
+		while(m_count > 0 && m_heap[0]->m_expire <= now)
+		{
+			Timer *p = m_heap[0];
+			p->m_duration = p->m_expire - now;
+			remove(0);
+			if(p->group() != NULL)
+			{
+				defer(p);
+				continue;
+			}
+			flush();
+			p->timeout();
+			now = Clock::read();
+		}
+		flush();
+		now = Clock::read();
+		/* A long group expiry may have left other timers due. */
+		if(m_count == 0 || m_heap[0]->m_expire > now)
+			break;
 	}
-	if(m_first.m_next != NULL)
-		t->set(m_first.m_next->m_duration);
+	if(m_count == 0)
+		return NULL;
+	t->set(m_heap[0]->m_expire - now);
 	return t;
 }
-
@@ -3,6 +3,32 @@
 
 #include <time.h>
 
+/* Source of the current time of Time and the timers, in seconds. The
+   monotonic clock is read while no other clock is installed. */
+
+class Clock
+{
+public:
+	static Clock *m_current;
+
+	virtual double now() = 0;
+	virtual ~Clock() {}
+	static void install(Clock *clock);
+	static double read();
+};
+
+/* Time that only moves when told to, for simulations. */
+
+class VirtualClock : public Clock
+{
+	double m_now;
+public:
+	VirtualClock(double start = 0.);
+	double now() {return m_now;}
+	void set(double t);
+	void advance(double d);
+};
+
 class Time : public timespec
 {
 	void normalize();
@@ -14,30 +40,61 @@ public:
 	void set(double d);
 };
 
+class Timer;
+
+/* Gets at once all the timers of the group found due in one check, instead
+   of a timeout() each. */
+
+class TimerGroup
+{
+public:
+	virtual void expire(Timer **timers, int n) = 0;
+};
+
 class Timer
 {
 public:
 	double m_duration;
-	Timer *m_next;
+	double m_expire;
+	int m_index;
 	bool active;
 
 	Timer(double t = 0);
 	void set(double t);
 	virtual void timeout() {}
+	virtual TimerGroup *group() {return NULL;}
 };
 
+/* Binary min-heap ordered by expiration time. Every timer keeps its own
+   position in the heap so that it can be read or removed without walking
+   the list. */
+
 class TimerList
 {
-public:
-	Time m_ref;
-	Timer m_first;
+	Timer **m_heap;
+	int m_count;
+	int m_size;
+	Timer **m_due;
+	int m_due_count;
+	int m_due_size;
 
+	void grow(int count);
+	void place(Timer *timer, int index);
+	void siftUp(int index);
+	void siftDown(int index);
+	void remove(int index);
+	void defer(Timer *timer);
+	void flush();
+
+public:
  	TimerList();
+	~TimerList();
 
-	void refresh();
 	double read(Timer *timer);
 	void add(Timer *newtimer);
+	void addAll(Timer **timers, int n);
 	void del(Timer *timer);
+	bool next(double &expire);
 	Time* check(Time *t);
 };
 
@@ -3,6 +3,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "../common/addrset.h"
+#include "../common/netitf.h"
+#include "../common/policy.h"
 #include "config-server.h"
 
 ConfigServer::ConfigServer()
@@ -32,6 +34,17 @@ ConfigServer::ConfigServer()
 		new ConfigBool(true),
 		new ConfigString(NULL),
 		new ConfigString(NULL),
+		new ConfigInt(DEFAULT_RX_BATCH),
+		new ConfigBool(false),
+		new ConfigBool(false),
+		new ConfigBool(false),
+		new ConfigBool(false),
+		new ConfigString(NULL),
+		new ConfigString(NULL),
+		new ConfigString(NULL),
+		new ConfigString(NULL),
+		new ConfigString(NULL),
+		new ConfigInt(300),
 	};
 	m_root_tag = "ServerConfig";
 	m_array_tags = new const char*[ConfigItem::MAX_CONFIG_ITEM]
@@ -59,6 +72,17 @@ ConfigServer::ConfigServer()
 		"AlternateSetActive",
 		"NetworkId",
 		"VendorParameter",
+		"RxBatchSize",
+		"RxRing",
+		"DbHugePages",
+		"DbBTreeIndex",
+		"DbBuddyAllocator",
+		"UnicastAllocPolicy",
+		"MulticastAllocPolicy",
+		"Unicast64AllocPolicy",
+		"Multicast64AllocPolicy",
+		"JournalFile",
+		"JournalSnapshotInterval",
 	};
 }
 
@@ -107,6 +131,21 @@ bool ConfigServer::check(const char *fname)
 		fprintf(stderr, "%s: Incoherent size of MaxAssignedMulticast64\n", fname);
 		return false;
 	}
+	if(TO_UINT(get(ConfigItem::RX_BATCH)) == 0)
+	{
+		fprintf(stderr, "%s: RxBatchSize must be at least 1\n", fname);
+		return false;
+	}
+	for(int i=ConfigItem::UNICAST_POLICY; i<=ConfigItem::MULTICAST_64_POLICY; i++)
+	{
+		AllocPolicy *policy = AllocPolicy::create((const char *) TO_STRING(get(i)));
+		if(TO_STRING(get(i)) != NULL && policy == NULL)
+		{
+			fprintf(stderr, "%s: Unknown allocation policy in %s\n", fname, m_array_tags[i]);
+			return false;
+		}
+		delete policy;
+	}
 	if(TO_BOOL(get(ConfigItem::DEFAULT_MULTICAST)))
 	{
 		if(TO_BOOL(get(ConfigItem::DEFAULT_64)))
@@ -28,6 +28,17 @@ enum ConfigItem
 	ENABLE_ALTERNATE_SET,
 	NETWORK_ID,
 	VENDOR,
+	RX_BATCH,
+	RX_RING,
+	DB_HUGE_PAGES,
+	DB_BTREE_INDEX,
+	DB_BUDDY,
+	UNICAST_POLICY,
+	MULTICAST_POLICY,
+	UNICAST_64_POLICY,
+	MULTICAST_64_POLICY,
+	JOURNAL_FILE,
+	JOURNAL_SNAPSHOT_INTERVAL,
 	MAX_CONFIG_ITEM,
 };
 
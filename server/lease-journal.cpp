@@ -0,0 +1,606 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "lease-journal.h"
+
+#define RING_MASK		(JOURNAL_RING_SIZE - 1)
+#define MIN_LIFETIME	0.001
+#define MAX(a,b) ((a > b) ? a : b)
+
+static void writeAll(int fd, const void *buf, size_t len, const char *what)
+{
+	const uint8_t *p = (const uint8_t *) buf;
+	while(len > 0)
+	{
+		ssize_t n = write(fd, p, len);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			perror(what);
+			exit(1);
+		}
+		p += n;
+		len -= n;
+	}
+}
+
+/* Returns what could be read before the end of the file. */
+
+static size_t readAll(int fd, void *buf, size_t len, const char *what)
+{
+	uint8_t *p = (uint8_t *) buf;
+	size_t done = 0;
+	while(done < len)
+	{
+		ssize_t n = read(fd, p + done, len - done);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			perror(what);
+			exit(1);
+		}
+		if(n == 0)
+			break;
+		done += n;
+	}
+	return done;
+}
+
+static SnapshotLease *collect(TreeNode *node, SnapshotLease *l, double now, EventLoop *loop)
+{
+	if(node == NULL)
+		return l;
+	for(int i = 0; i < 3; i++)
+	{
+		l = collect(node->m_child[i], l, now, loop);
+		AssignableSet *set = (i < 2) ? node->m_set[i] : NULL;
+		if(set == NULL || set->m_next_free != NULL)
+			continue;
+		memset(l, 0, sizeof(SnapshotLease));
+		l->m_first = set->getFirstAddr();
+		l->m_count = set->getSize();
+		l->m_security_id = set->m_security_id;
+		l->m_expire = now + loop->readTimer(set);
+		l->m_reserved = set->m_reserved;
+		l++;
+	}
+	return l;
+}
+
+LeaseJournal::LeaseJournal() :	m_path(NULL),
+								m_snap_path(NULL),
+								m_fd(-1),
+								m_ndbs(0),
+								m_key_hash(NULL),
+								m_loop(NULL),
+								m_interval(0),
+								m_ring(NULL),
+								m_head(0),
+								m_tail(0),
+								m_tail_seen(0),
+								m_seq(0),
+								m_snap_buf(NULL),
+								m_snap_len(0),
+								m_running(false),
+								m_stop(false),
+								m_idle(false),
+								m_records(0),
+								m_commits(0),
+								m_stalls(0),
+								m_snapshots(0),
+								m_restored(0),
+								m_replayed(0),
+								m_restore_time(0)
+{
+	pthread_mutex_init(&m_lock, NULL);
+	pthread_cond_init(&m_more, NULL);
+	pthread_cond_init(&m_room, NULL);
+}
+
+LeaseJournal::~LeaseJournal()
+{
+	close();
+	free(m_path);
+	free(m_snap_path);
+	free(m_ring);
+	pthread_mutex_destroy(&m_lock);
+	pthread_cond_destroy(&m_more);
+	pthread_cond_destroy(&m_room);
+}
+
+double LeaseJournal::wallTime()
+{
+	timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+bool LeaseJournal::isOpen()
+{
+	return m_running;
+}
+
+/* Rebuilds the databases from the snapshot and the journal, stores a
+   fresh snapshot and starts journaling from an empty file. The databases
+   must be initialized and still untouched. */
+
+void LeaseJournal::open(const char *path, SetDatabase **dbs, int ndbs, SipHash *key_hash, EventLoop *loop, double interval)
+{
+	if(ndbs > JOURNAL_MAX_DBS)
+	{
+		fprintf(stderr, "Too many databases for the lease journal\n");
+		exit(1);
+	}
+	m_path = strdup(path);
+	m_snap_path = (char *) malloc(strlen(path) + 6);
+	sprintf(m_snap_path, "%s.snap", path);
+	for(int i = 0; i < ndbs; i++)
+		m_dbs[i] = dbs[i];
+	m_ndbs = ndbs;
+	m_key_hash = key_hash;
+	m_loop = loop;
+	m_interval = interval;
+	m_ring = (JournalRecord *) calloc(JOURNAL_RING_SIZE, sizeof(JournalRecord));
+	if(m_ring == NULL)
+	{
+		perror("Allocating journal ring");
+		exit(1);
+	}
+
+	Time start;
+	m_seq = loadSnapshot();
+	replayJournal(m_seq);
+	m_restore_time = Time().elapsed(start);
+
+	uint8_t *buf;
+	size_t len = capture(buf);
+	writeSnapshot(buf, len);
+	free(buf);
+	m_fd = ::open(m_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+	if(m_fd < 0)
+	{
+		perror("Opening lease journal");
+		exit(1);
+	}
+
+	for(int i = 0; i < m_ndbs; i++)
+		m_dbs[i]->setListener(this);
+	m_stop = false;
+	if(pthread_create(&m_thread, NULL, writerMain, this) != 0)
+	{
+		fprintf(stderr, "Starting journal writer failed\n");
+		exit(1);
+	}
+	m_running = true;
+	if(m_interval > 0)
+		m_loop->startTimer(this, m_interval);
+}
+
+void LeaseJournal::close()
+{
+	if(!m_running)
+		return;
+	m_loop->stopTimer(this);
+	for(int i = 0; i < m_ndbs; i++)
+		m_dbs[i]->setListener(NULL);
+	snapshot(true);
+	pthread_mutex_lock(&m_lock);
+	m_stop = true;
+	pthread_cond_signal(&m_more);
+	pthread_mutex_unlock(&m_lock);
+	pthread_join(m_thread, NULL);
+	::close(m_fd);
+	m_fd = -1;
+	m_running = false;
+}
+
+int LeaseJournal::dbIndex(SetDatabase *db)
+{
+	for(int i = 0; i < m_ndbs; i++)
+		if(m_dbs[i] == db)
+			return i;
+	return -1;
+}
+
+/* Single producer ring: the event loop only takes the lock to wake up an
+   idle writer or to wait for room when the ring is full. */
+
+void LeaseJournal::push(JournalRecord *rec)
+{
+	if(m_head - m_tail_seen == JOURNAL_RING_SIZE)
+	{
+		m_tail_seen = __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+		if(m_head - m_tail_seen == JOURNAL_RING_SIZE)
+		{
+			m_stalls++;
+			pthread_mutex_lock(&m_lock);
+			while(m_head - (m_tail_seen = __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE)) == JOURNAL_RING_SIZE)
+				pthread_cond_wait(&m_room, &m_lock);
+			pthread_mutex_unlock(&m_lock);
+		}
+	}
+	rec->m_seq = ++m_seq;
+	m_ring[m_head & RING_MASK] = *rec;
+	__atomic_store_n(&m_head, m_head + 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&m_idle, __ATOMIC_SEQ_CST))
+	{
+		pthread_mutex_lock(&m_lock);
+		pthread_cond_signal(&m_more);
+		pthread_mutex_unlock(&m_lock);
+	}
+}
+
+void LeaseJournal::append(JournalOp op, SetDatabase *db, AssignableSet *set, double lifetime)
+{
+	JournalRecord rec;
+	int index = dbIndex(db);
+
+	if(index < 0)
+		return;
+	memset(&rec, 0, sizeof(rec));
+	rec.m_first = set->getFirstAddr();
+	rec.m_count = set->getSize();
+	rec.m_security_id = set->m_security_id;
+	rec.m_expire = (lifetime > 0) ? wallTime() + lifetime : 0;
+	rec.m_op = (uint8_t) op;
+	rec.m_db = index;
+	push(&rec);
+	m_records++;
+}
+
+void LeaseJournal::onLease(SetDatabase *db, AssignableSet *set, double lifetime)
+{
+	append(set->m_reserved ? JournalOp::RESERVE : JournalOp::ASSIGN, db, set, lifetime);
+}
+
+void LeaseJournal::onFree(SetDatabase *db, AssignableSet *set, bool expired)
+{
+	append(expired ? JournalOp::TIMEOUT : JournalOp::RELEASE, db, set, 0);
+}
+
+void LeaseJournal::timeout()
+{
+	snapshot(false);
+	m_loop->startTimer(this, m_interval);
+}
+
+/* Copies the leases and queues them behind the records already pending.
+   Unless told to wait, it is skipped while the previous one is still
+   being written. */
+
+void LeaseJournal::snapshot(bool wait)
+{
+	pthread_mutex_lock(&m_lock);
+	while(m_snap_buf != NULL)
+	{
+		if(!wait)
+		{
+			pthread_mutex_unlock(&m_lock);
+			return;
+		}
+		pthread_cond_wait(&m_room, &m_lock);
+	}
+	pthread_mutex_unlock(&m_lock);
+
+	uint8_t *buf;
+	size_t len = capture(buf);
+	pthread_mutex_lock(&m_lock);
+	m_snap_buf = buf;
+	m_snap_len = len;
+	pthread_mutex_unlock(&m_lock);
+
+	JournalRecord rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.m_op = (uint8_t) JournalOp::SNAPSHOT;
+	push(&rec);
+}
+
+size_t LeaseJournal::capture(uint8_t *&buf)
+{
+	uint64_t sets = 0;
+	for(int i = 0; i < m_ndbs; i++)
+		sets += m_dbs[i]->m_set_pool.m_in_use;
+	buf = (uint8_t *) malloc(sizeof(SnapshotHeader) + sets * sizeof(SnapshotLease));
+	if(buf == NULL)
+	{
+		perror("Allocating lease snapshot");
+		exit(1);
+	}
+
+	SnapshotHeader *h = (SnapshotHeader *) buf;
+	SnapshotLease *l = (SnapshotLease *) (h + 1);
+	double now = wallTime();
+	memset(h, 0, sizeof(SnapshotHeader));
+	memcpy(h->m_magic, SNAPSHOT_MAGIC, sizeof(h->m_magic));
+	h->m_version = SNAPSHOT_VERSION;
+	h->m_ndbs = m_ndbs;
+	h->m_seq = m_seq;
+	h->m_time = now;
+	m_key_hash->getKey(h->m_key[0], h->m_key[1]);
+	for(int i = 0; i < m_ndbs; i++)
+	{
+		SnapshotLease *end = collect(m_dbs[i]->m_root, l, now, m_loop);
+		h->m_db[i].m_first = m_dbs[i]->m_total_set.getFirstAddr();
+		h->m_db[i].m_count = m_dbs[i]->m_total_set.getSize();
+		h->m_db[i].m_offset = (uint8_t *) l - buf;
+		h->m_db[i].m_leases = end - l;
+		l = end;
+	}
+	h->m_size = (uint8_t *) l - buf;
+	return h->m_size;
+}
+
+void LeaseJournal::writeSnapshot(uint8_t *buf, size_t len)
+{
+	SnapshotHeader *h = (SnapshotHeader *) buf;
+	char *tmp_path = (char *) malloc(strlen(m_snap_path) + 5);
+
+	h->m_check = snapshotImageChecksum(buf, len);
+	sprintf(tmp_path, "%s.tmp", m_snap_path);
+	int fd = ::open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(fd < 0)
+	{
+		perror("Creating lease snapshot");
+		exit(1);
+	}
+	writeAll(fd, buf, len, "Writing lease snapshot");
+	if(fsync(fd) < 0 || ::close(fd) < 0 || rename(tmp_path, m_snap_path) < 0)
+	{
+		perror("Storing lease snapshot");
+		exit(1);
+	}
+	free(tmp_path);
+	m_snapshots++;
+}
+
+/* Returns the sequence number the snapshot is up to date with. Databases
+   whose set is unchanged are bulk loaded from the mapped lease arrays;
+   otherwise each lease that still fits is restored on its own. */
+
+uint64_t LeaseJournal::loadSnapshot()
+{
+	int fd = ::open(m_snap_path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+	{
+		if(errno == ENOENT)
+			return 0;
+		perror("Opening lease snapshot");
+		exit(1);
+	}
+	struct stat st;
+	if(fstat(fd, &st) < 0 || st.st_size == 0)
+	{
+		::close(fd);
+		fprintf(stderr, "Ignoring invalid lease snapshot %s\n", m_snap_path);
+		return 0;
+	}
+	uint8_t *buf = (uint8_t *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	::close(fd);
+	if(buf == MAP_FAILED)
+	{
+		perror("Mapping lease snapshot");
+		exit(1);
+	}
+
+	SnapshotHeader *h = (SnapshotHeader *) buf;
+	if(!snapshotValid(buf, st.st_size) || h->m_ndbs != (uint32_t) m_ndbs)
+	{
+		fprintf(stderr, "Ignoring invalid lease snapshot %s\n", m_snap_path);
+		munmap(buf, st.st_size);
+		return 0;
+	}
+
+	double now = wallTime();
+	m_key_hash->setKey(h->m_key[0], h->m_key[1]);
+	for(int i = 0; i < m_ndbs; i++)
+	{
+		SnapshotDb *sdb = &h->m_db[i];
+		SnapshotLease *leases = (SnapshotLease *) (buf + sdb->m_offset);
+		AddrSet *set = &m_dbs[i]->m_total_set;
+		if(sdb->m_first != set->getFirstAddr() || sdb->m_count != set->getSize()
+			|| !loadLeases(m_dbs[i], leases, sdb->m_leases, now))
+			restoreLeases(m_dbs[i], leases, sdb->m_leases, now);
+		m_restored += sdb->m_leases;
+	}
+	uint64_t seq = h->m_seq;
+	munmap(buf, st.st_size);
+	return seq;
+}
+
+bool LeaseJournal::loadLeases(SetDatabase *db, SnapshotLease *leases, uint64_t n, double now)
+{
+	LeaseEntry *entries = (LeaseEntry *) malloc((n + 1) * sizeof(LeaseEntry));
+	if(entries == NULL)
+	{
+		perror("Loading lease snapshot");
+		exit(1);
+	}
+	for(uint64_t i = 0; i < n; i++)
+	{
+		entries[i].m_first = leases[i].m_first;
+		entries[i].m_count = leases[i].m_count;
+		entries[i].m_status = leases[i].m_reserved ? DbStatus::RESERVED : DbStatus::ASSIGNED;
+		entries[i].m_security_id = leases[i].m_security_id;
+		entries[i].m_lifetime = leases[i].m_expire - now;
+	}
+	bool loaded = db->load(&db->m_total_set, entries, n);
+	free(entries);
+	return loaded;
+}
+
+void LeaseJournal::restoreLeases(SetDatabase *db, SnapshotLease *leases, uint64_t n, double now)
+{
+	for(uint64_t i = 0; i < n; i++)
+	{
+		AddrSet set(leases[i].m_first, leases[i].m_count);
+		db->restore(&set, leases[i].m_security_id, leases[i].m_reserved,
+					MAX(leases[i].m_expire - now, MIN_LIFETIME));
+	}
+}
+
+/* Replays the records newer than the snapshot, up to the first one that
+   was not completely written. */
+
+void LeaseJournal::replayJournal(uint64_t seq)
+{
+	int fd = ::open(m_path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+	{
+		if(errno == ENOENT)
+			return;
+		perror("Opening lease journal");
+		exit(1);
+	}
+	struct stat st;
+	if(fstat(fd, &st) < 0)
+	{
+		perror("Reading lease journal");
+		exit(1);
+	}
+	JournalRecord *r = (JournalRecord *) malloc(st.st_size + 1);
+	if(r == NULL)
+	{
+		perror("Reading lease journal");
+		exit(1);
+	}
+	size_t len = readAll(fd, r, st.st_size, "Reading lease journal");
+	::close(fd);
+
+	double now = wallTime();
+	for(size_t i = 0; i < len / sizeof(JournalRecord); i++)
+	{
+		if(check(&r[i]) != r[i].m_check)
+			break;
+		if(r[i].m_seq <= seq)
+			continue;
+		apply(&r[i], now);
+		m_replayed++;
+		m_seq = r[i].m_seq;
+	}
+	free(r);
+}
+
+void LeaseJournal::apply(JournalRecord *r, double now)
+{
+	if(r->m_db >= m_ndbs)
+		return;
+	SetDatabase *db = m_dbs[r->m_db];
+	AddrSet set(r->m_first, r->m_count);
+	AssignableSet *result;
+
+	switch((JournalOp) r->m_op)
+	{
+		case JournalOp::RESERVE:
+		case JournalOp::ASSIGN:
+			db->restore(&set, r->m_security_id, r->m_op == (uint8_t) JournalOp::RESERVE,
+						MAX(r->m_expire - now, MIN_LIFETIME));
+			break;
+		case JournalOp::RELEASE:
+		case JournalOp::TIMEOUT:
+			result = db->search(r->m_first);
+			if(result != NULL && result->m_next_free == NULL
+				&& result->getFirstAddr() == r->m_first && result->getSize() == r->m_count)
+				db->release(result);
+			break;
+		default:
+			break;
+	}
+}
+
+uint32_t LeaseJournal::check(JournalRecord *r)
+{
+	return (uint32_t) snapshotChecksum(r, offsetof(JournalRecord, m_check));
+}
+
+void *LeaseJournal::writerMain(void *arg)
+{
+	((LeaseJournal *) arg)->writer();
+	return NULL;
+}
+
+/* Everything queued while the previous batch was being synced goes out
+   with a single write and fdatasync. The event loop only signals the
+   writer when it is waiting for records. */
+
+void LeaseJournal::writer()
+{
+	uint64_t tail = m_tail;
+
+	pthread_mutex_lock(&m_lock);
+	while(true)
+	{
+		__atomic_store_n(&m_idle, true, __ATOMIC_SEQ_CST);
+		while(tail == __atomic_load_n(&m_head, __ATOMIC_SEQ_CST) && !m_stop)
+			pthread_cond_wait(&m_more, &m_lock);
+		__atomic_store_n(&m_idle, false, __ATOMIC_SEQ_CST);
+		uint64_t head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+		if(tail == head)
+			break;
+		pthread_mutex_unlock(&m_lock);
+		commit(tail, head);
+		tail = head;
+		pthread_mutex_lock(&m_lock);
+		__atomic_store_n(&m_tail, tail, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&m_room);
+	}
+	pthread_mutex_unlock(&m_lock);
+}
+
+void LeaseJournal::commit(uint64_t from, uint64_t to)
+{
+	uint64_t start = from;
+	for(uint64_t i = from; i < to; i++)
+	{
+		JournalRecord *r = &m_ring[i & RING_MASK];
+		if(r->m_op != (uint8_t) JournalOp::SNAPSHOT)
+		{
+			r->m_check = check(r);
+			continue;
+		}
+		writeRecords(start, i);
+		start = i + 1;
+
+		pthread_mutex_lock(&m_lock);
+		uint8_t *buf = m_snap_buf;
+		size_t len = m_snap_len;
+		pthread_mutex_unlock(&m_lock);
+		writeSnapshot(buf, len);
+		if(ftruncate(m_fd, 0) < 0)
+		{
+			perror("Truncating lease journal");
+			exit(1);
+		}
+		pthread_mutex_lock(&m_lock);
+		free(m_snap_buf);
+		m_snap_buf = NULL;
+		pthread_cond_broadcast(&m_room);
+		pthread_mutex_unlock(&m_lock);
+	}
+	writeRecords(start, to);
+	if(fdatasync(m_fd) < 0)
+	{
+		perror("Syncing lease journal");
+		exit(1);
+	}
+	m_commits++;
+}
+
+void LeaseJournal::writeRecords(uint64_t from, uint64_t to)
+{
+	while(from < to)
+	{
+		uint64_t idx = from & RING_MASK;
+		uint64_t n = to - from;
+		if(n > JOURNAL_RING_SIZE - idx)
+			n = JOURNAL_RING_SIZE - idx;
+		writeAll(m_fd, &m_ring[idx], n * sizeof(JournalRecord), "Writing lease journal");
+		from += n;
+	}
+}
@@ -0,0 +1,114 @@
+#ifndef LEASE_JOURNAL_H
+#define LEASE_JOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "../common/database.h"
+#include "../common/eventloop.h"
+#include "../common/siphash.h"
+#include "../common/snapshot.h"
+
+#define JOURNAL_MAX_DBS		SNAPSHOT_MAX_DBS
+#define JOURNAL_RING_SIZE	65536	/* records, power of 2 */
+
+enum class JournalOp : uint8_t
+{
+	RESERVE,
+	ASSIGN,
+	RELEASE,
+	TIMEOUT,
+	SNAPSHOT,
+};
+
+/* Expiry times are absolute wall clock seconds, so that they survive a
+   restart of the server (or of the host). */
+
+struct JournalRecord
+{
+	uint64_t m_seq;
+	uint64_t m_first;
+	uint64_t m_count;
+	uint64_t m_security_id;
+	double m_expire;
+	uint8_t m_op;
+	uint8_t m_db;
+	uint16_t m_pad;
+	uint32_t m_check;
+};
+
+/*
+ * Append-only journal of the leases of the server databases. The event
+ * loop only copies each event into a ring; a writer thread drains it,
+ * writing everything pending with a single write and fdatasync (group
+ * commit). Every snapshot interval the leases are copied into a snapshot,
+ * which the writer stores next to the journal before truncating it. At
+ * startup the databases are built from the mapped snapshot, the journal
+ * tail is replayed over them and the key of the security ids restored.
+ */
+
+class LeaseJournal : public LeaseListener, public Timer
+{
+	char *m_path;
+	char *m_snap_path;
+	int m_fd;
+	SetDatabase *m_dbs[JOURNAL_MAX_DBS];
+	int m_ndbs;
+	SipHash *m_key_hash;
+	EventLoop *m_loop;
+	double m_interval;
+
+	JournalRecord *m_ring;
+	uint64_t m_head;
+	uint64_t m_tail;
+	uint64_t m_tail_seen;
+	uint64_t m_seq;
+	uint8_t *m_snap_buf;
+	size_t m_snap_len;
+	pthread_mutex_t m_lock;
+	pthread_cond_t m_more;
+	pthread_cond_t m_room;
+	pthread_t m_thread;
+	bool m_running;
+	bool m_stop;
+	bool m_idle;
+
+	static void *writerMain(void *arg);
+	void writer();
+	void commit(uint64_t from, uint64_t to);
+	void writeRecords(uint64_t from, uint64_t to);
+	uint32_t check(JournalRecord *r);
+	void push(JournalRecord *rec);
+	void append(JournalOp op, SetDatabase *db, AssignableSet *set, double lifetime);
+	int dbIndex(SetDatabase *db);
+	size_t capture(uint8_t *&buf);
+	void writeSnapshot(uint8_t *buf, size_t len);
+	uint64_t loadSnapshot();
+	bool loadLeases(SetDatabase *db, SnapshotLease *leases, uint64_t n, double now);
+	void restoreLeases(SetDatabase *db, SnapshotLease *leases, uint64_t n, double now);
+	void replayJournal(uint64_t seq);
+	void apply(JournalRecord *r, double now);
+
+public:
+	uint64_t m_records;
+	uint64_t m_commits;
+	uint64_t m_stalls;
+	uint64_t m_snapshots;
+	uint64_t m_restored;
+	uint64_t m_replayed;
+	double m_restore_time;
+
+	LeaseJournal();
+	~LeaseJournal();
+	void open(const char *path, SetDatabase **dbs, int ndbs, SipHash *key_hash, EventLoop *loop, double interval);
+	void snapshot(bool wait);
+	void close();
+	bool isOpen();
+	void onLease(SetDatabase *db, AssignableSet *set, double lifetime);
+	void onFree(SetDatabase *db, AssignableSet *set, bool expired);
+	void timeout();
+
+	static double wallTime();
+};
+
+#endif
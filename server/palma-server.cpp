@@ -4,6 +4,7 @@
 
 #include "palma-server.h"
 #include "../common/details.h"
+#include "../common/policy.h"
 
 #define MIN(a,b) ((a < b) ? a : b)
 
@@ -11,35 +12,99 @@ PalmaServer::PalmaServer() : 	m_db_unicast(this),
 								m_db_multicast(this),
 								m_db_unicast_64(this),
 								m_db_multicast_64(this),
-								m_src_addr(0) {}
+								m_src_addr(0),
+								m_cache_key(0),
+								m_reoffers(0) {}
 
 void PalmaServer::begin()
 {
+	m_netitf.setBatchSize(TO_UINT(m_config.get(ConfigItem::RX_BATCH)));
+	m_netitf.setRxRing(TO_BOOL(m_config.get(ConfigItem::RX_RING)));
 	m_netitf.init(TO_STRING(m_config.get(ConfigItem::INTERFACE)));
 	m_event_loop.regSource(&m_netitf);
 	m_event_loop.regHandler(this);
+	setup();
+	m_event_loop.run();
+	m_journal.close();
+}
+
+/* Runs over a transport, inside a program that drives the event loop
+   itself. */
+
+void PalmaServer::begin(Transport *transport)
+{
+	m_netitf.init(transport);
+	setup();
+}
+
+void PalmaServer::setup()
+{
 	m_src_addr = TO_ADDR(m_config.get(ConfigItem::SRC_ADDR));
+	m_netitf.setMcastTypes(MSG_BIT(MsgType::DISCOVER) | 
+		(TO_BOOL(m_config.get(ConfigItem::AUTOASSIGN_OBJECTION)) ? MSG_BIT(MsgType::ANNOUNCE) : 0));
+	m_netitf.addAddr(PALMA_MCAST, true);
 	m_netitf.addAddr(m_src_addr);
+	initTemplates();
 
 	AddrSet *unicast_set = TO_ADDRSET_PTR(m_config.get(ConfigItem::UNICAST_SET));
 	AddrSet *multicast_set = TO_ADDRSET_PTR(m_config.get(ConfigItem::MULTICAST_SET));
 	AddrSet *unicast_64_set = TO_ADDRSET_PTR(m_config.get(ConfigItem::UNICAST_64_SET));
 	AddrSet *multicast_64_set = TO_ADDRSET_PTR(m_config.get(ConfigItem::MULTICAST_64_SET));
+	bool huge = TO_BOOL(m_config.get(ConfigItem::DB_HUGE_PAGES));
+	bool btree = TO_BOOL(m_config.get(ConfigItem::DB_BTREE_INDEX));
+	bool buddy = TO_BOOL(m_config.get(ConfigItem::DB_BUDDY));
+	SetDatabase *dbs[] = {&m_db_unicast, &m_db_multicast, &m_db_unicast_64, &m_db_multicast_64};
+	for(int i=0; i<4; i++)
+	{
+		dbs[i]->setHugePages(huge);
+		dbs[i]->setBTreeIndex(btree);
+	}
+	/* Single addresses are the usual unicast lease, which would only
+	   fragment the buddy blocks. */
+	m_db_multicast.setBuddy(buddy);
+	m_db_unicast_64.setBuddy(buddy);
+	m_db_multicast_64.setBuddy(buddy);
+	for(int i=0; i<4; i++)
+		dbs[i]->setPolicy(AllocPolicy::create((const char *) TO_STRING(m_config.get(ConfigItem::UNICAST_POLICY + i))));
 	m_db_unicast.init(unicast_set);
 	m_db_multicast.init(multicast_set);
 	m_db_unicast_64.init(unicast_64_set);
 	m_db_multicast_64.init(multicast_64_set);
-	m_event_loop.run();
+
+	uint8_t *journal = TO_STRING(m_config.get(ConfigItem::JOURNAL_FILE));
+	if(journal != NULL)
+	{
+		m_journal.open((const char *) journal, dbs, 4, &m_hash, &m_event_loop,
+						TO_UINT(m_config.get(ConfigItem::JOURNAL_SNAPSHOT_INTERVAL)));
+		printf("JOURNAL: restored %lu leases and %lu records in %.1f ms\n",
+				m_journal.m_restored, m_journal.m_replayed, m_journal.m_restore_time * 1e3);
+	}
 }
 
-void PalmaServer::handlePacket(Packet *pkt)
+void PalmaServer::initTemplates()
 {
+	uint8_t *id;
+
+	m_offer_tpl.init(MsgType::OFFER, m_src_addr);
+	id = TO_STRING(m_config.get(ConfigItem::NETWORK_ID));
+	if(id != NULL)
+		m_offer_tpl.addIdPar(ParType::NETWORK_ID, id);
+	id = TO_STRING(m_config.get(ConfigItem::VENDOR));
+	if(id != NULL)
+		m_offer_tpl.addVendorPar(id, strlen((const char *)id));
+	m_ack_tpl.init(MsgType::ACK, m_src_addr);
+}
+
+void PalmaServer::handlePacket(PacketView *pkt)
+{
+	m_cache_key = 0;
 	if(pkt->getDA() == PALMA_MCAST)
 	{
 		switch(pkt->getType())
 		{
 			case MsgType::DISCOVER:
-				processClaim(pkt);
+				if(!replay(pkt))
+					processClaim(pkt);
 				break;
 			case MsgType::ANNOUNCE:
 				if(TO_BOOL(m_config.get(ConfigItem::AUTOASSIGN_OBJECTION)))
@@ -52,7 +117,8 @@ void PalmaServer::handlePacket(Packet *pkt)
 		switch(pkt->getType())
 		{
 			case MsgType::REQUEST:
-				processRequest(pkt);
+				if(!replay(pkt))
+					processRequest(pkt);
 				break;
 			case MsgType::RELEASE:
 				processRelease(pkt);
@@ -61,6 +127,25 @@ void PalmaServer::handlePacket(Packet *pkt)
 	}
 }
 
+bool PalmaServer::replay(PacketView *pkt)
+{
+	uint16_t len;
+
+	m_cache_key = m_cache.key(pkt);
+	uint8_t *frame = m_cache.lookup(m_cache_key, pkt->getSA(), len);
+	if(frame == NULL)
+		return false;
+	m_netitf.netsend(frame, len);
+	return true;
+}
+
+void PalmaServer::sendResponse(PacketTemplate *tpl, int len)
+{
+	m_netitf.netsend(tpl->getData(), len);
+	if(m_cache_key != 0)
+		m_cache.store(m_cache_key, tpl->getData(), len, TO_UINT(m_config.get(ConfigItem::RESERVE_LIFETIME)));
+}
+
 bool PalmaServer::defineSet(bool isMulticast, bool isSize64, SetDatabase *&db, uint64_t *max_addr, uint16_t *lifetime, bool *send_client_addr)
 {
 	uint64_t max_addr_unicast = TO_SIZE(m_config.get(ConfigItem::MAX_ADDR_UNICAST));
@@ -122,13 +207,14 @@ bool PalmaServer::defineSet(bool isMulticast, bool isSize64, SetDatabase *&db, u
 	return true;
 }
 
-void PalmaServer::processClaim(Packet *pkt)
+void PalmaServer::processClaim(PacketView *pkt)
 {
 	uint64_t src_addr = pkt->getSA();
 	uint8_t *station_id = pkt->getStationId();
+	uint8_t station_id_len = pkt->getStationIdLen();
 	uint16_t token = pkt->getToken();
 	AddrSet *claimed_set = pkt->getSet();
-	uint64_t security_id = getSecurityId(token, station_id);
+	uint64_t security_id = getSecurityId(token, station_id, station_id_len);
 	bool isMulticast;
 	bool isSize64;
 	uint64_t max_addr_offer;
@@ -159,6 +245,8 @@ void PalmaServer::processClaim(Packet *pkt)
 	AddrSet *client_addr = NULL;
 
 	max_addr_offer = MIN(max_addr, max_addr_offer);
+	if(reoffer(db, src_addr, token, security_id, lifetime, station_id, station_id_len, send_client_addr))
+		return;
 	offer_set = db->reserve(max_addr_offer, security_id, TO_UINT(m_config.get(ConfigItem::RESERVE_LIFETIME)));
 	if(offer_set != NULL)
 	{
@@ -171,43 +259,59 @@ void PalmaServer::processClaim(Packet *pkt)
 				return;
 			}
 		}
-		sendOffer(src_addr, token, offer_set, lifetime, station_id, client_addr);
+		sendOffer(src_addr, token, offer_set, lifetime, station_id, station_id_len, client_addr);
 	}
 }
 
 
+/* A DISCOVER whose offer is still reserved is a retransmission (or the
+   same one from another source address), so the reserved sets are offered
+   again instead of new ones. */
+
+bool PalmaServer::reoffer(SetDatabase *db, uint64_t src_addr, uint16_t token, uint64_t security_id,
+				uint16_t lifetime, uint8_t *station_id, uint8_t station_id_len, bool send_client_addr)
+{
+	AssignableSet *offer_set = db->findLease(security_id);
+	AssignableSet *client_addr = NULL;
+	AddrSet src_addr_set(src_addr);
+	AddrSet check_set;
+	uint16_t reserve_lifetime = TO_UINT(m_config.get(ConfigItem::RESERVE_LIFETIME));
+
+	if(offer_set == NULL || !offer_set->m_reserved)
+		return false;
+	if(send_client_addr && check_set.checkConflict(&src_addr_set, &DISCOVER_SOURCE_ADDR_RANGE))
+	{
+		client_addr = m_db_unicast.findLease(security_id);
+		if(client_addr == NULL || !client_addr->m_reserved)
+			return false;
+		m_db_unicast.renew(client_addr, reserve_lifetime);
+	}
+	db->renew(offer_set, reserve_lifetime);
+	m_reoffers++;
+	sendOffer(src_addr, token, offer_set, lifetime, station_id, station_id_len, client_addr);
+	return true;
+}
+
 void PalmaServer::sendOffer(uint64_t dest_addr, uint16_t token, AddrSet *offer_set, 
-				uint16_t lifetime, uint8_t *station_id, AddrSet *client_addr)
+				uint16_t lifetime, uint8_t *station_id, uint8_t station_id_len, AddrSet *client_addr)
 {
-	uint8_t *id;
-	
-	Packet pkt(MsgType::OFFER, dest_addr, m_src_addr, token);
-	pkt.addLifetimePar(lifetime);
 	if(offer_set->getSize() > 0xffff)
 		offer_set->alignToMask(SetType::MASK);
-	pkt.addMacSetPar(offer_set);
-	if(station_id != NULL)
-		pkt.addIdPar(ParType::STATION_ID, station_id);
-	id = TO_STRING(m_config.get(ConfigItem::NETWORK_ID));
-	if(id != NULL)
-		pkt.addIdPar(ParType::NETWORK_ID, id);
-	if(client_addr != NULL)
-		pkt.addClientAddrPar(client_addr);
-	id = TO_STRING(m_config.get(ConfigItem::VENDOR));
-	if(id != NULL)
-		pkt.addVendorPar(id, strlen((const char *)id));
-	m_netitf.netsend(&pkt);
+	int len = m_offer_tpl.fill(dest_addr, token, StatusCode::NO_CODE, offer_set, lifetime, 
+								station_id, station_id_len, client_addr);
+	sendResponse(&m_offer_tpl, len);
 }
 
-void PalmaServer::processRequest(Packet *pkt)
+void PalmaServer::processRequest(PacketView *pkt)
 {
 	uint64_t security_id;
 	AddrSet *requested_set = pkt->getSet();
 	uint8_t * station_id = pkt->getStationId();
+	uint8_t station_id_len = pkt->getStationIdLen();
 	uint16_t token = pkt->getToken();
 	uint64_t src_addr = pkt->getSA();
-	uint64_t reserved_security_id = getSecurityId(token, station_id);
-	uint64_t assigned_security_id = getSecurityId(token, station_id, src_addr);
+	uint64_t reserved_security_id = getSecurityId(token, station_id, station_id_len);
+	uint64_t assigned_security_id = getSecurityId(token, station_id, station_id_len, src_addr);
 
 	bool isSize64 =  requested_set->isSize64();
 	bool isMulticast = requested_set->isMulticast();
@@ -222,7 +326,7 @@ void PalmaServer::processRequest(Packet *pkt)
 		|| check_set.checkConflict(&src_addr_set, &AUTOASSIGN_UNICAST)
 		|| check_set.checkConflict(&src_addr_set, &DISCOVER_SOURCE_ADDR_RANGE) )
 	{
-		sendAck(src_addr, token, station_id, StatusCode::FAIL_OTHER);
+		sendAck(src_addr, token, station_id, station_id_len, StatusCode::FAIL_OTHER);
 		return;
 	}
 	
@@ -243,7 +347,7 @@ void PalmaServer::processRequest(Packet *pkt)
 		}
 		else
 		{
-			sendAck(src_addr, token, station_id, StatusCode::FAIL_OTHER);
+			sendAck(src_addr, token, station_id, station_id_len, StatusCode::FAIL_OTHER);
 			return;
 		}
 	}
@@ -257,13 +361,20 @@ void PalmaServer::processRequest(Packet *pkt)
 		}
 		else
 		{
-			sendAck(src_addr, token, station_id, StatusCode::FAIL_TOO_LARGE);
+			sendAck(src_addr, token, station_id, station_id_len, StatusCode::FAIL_TOO_LARGE);
 			return;
 		}
 				
 	}
 	
-	db_status = db->checkStatus(requested_set, security_id, left_lifetime, identical, result);
+	db_status = DbStatus::INVALID;
+	if(pkt->getRenewal())
+	{
+		security_id = assigned_security_id;
+		db_status = db->checkLease(security_id, requested_set, left_lifetime, identical, result);
+	}
+	if(db_status == DbStatus::INVALID)
+		db_status = db->checkStatus(requested_set, security_id, left_lifetime, identical, result);
 	
 	if (db_status == DbStatus::FREE 
 			|| ((db_status == DbStatus::RESERVED) && (security_id == reserved_security_id))
@@ -273,51 +384,44 @@ void PalmaServer::processRequest(Packet *pkt)
 		if(src_assign_set != NULL)
 			m_db_unicast.assign(src_assign_set, &src_addr_set, assigned_security_id, lifetime);
 		db->assign(result, requested_set, assigned_security_id, lifetime);
-		sendAck(src_addr, token, station_id, ack_status, requested_set, lifetime);
+		sendAck(src_addr, token, station_id, station_id_len, ack_status, requested_set, lifetime);
 	}
 
 	else if(db_status == DbStatus::ASSIGNED && security_id == assigned_security_id)
-		sendAck(src_addr, token, station_id, ack_status, requested_set, left_lifetime);
+		sendAck(src_addr, token, station_id, station_id_len, ack_status, requested_set, left_lifetime);
 
 	else if(TO_BOOL(m_config.get(ConfigItem::ENABLE_ALTERNATE_SET)))
 	{
 		AddrSet *set = db->assign(requested_set->getSize(), assigned_security_id, lifetime);
 		if(set == NULL)
-			sendAck(src_addr, token, station_id, StatusCode::FAIL_CONFLICT);
+			sendAck(src_addr, token, station_id, station_id_len, StatusCode::FAIL_CONFLICT);
 		else
 		{
 			if(src_assign_set != NULL)
 				m_db_unicast.assign(src_assign_set, &src_addr_set, assigned_security_id, lifetime);
-			sendAck(src_addr, token, station_id, StatusCode::ALTERNATE_SET, set, lifetime);
+			sendAck(src_addr, token, station_id, station_id_len, StatusCode::ALTERNATE_SET, set, lifetime);
 		}
 	}
 	else
-		sendAck(src_addr, token, station_id, StatusCode::FAIL_CONFLICT);									
+		sendAck(src_addr, token, station_id, station_id_len, StatusCode::FAIL_CONFLICT);									
 }
 
-void PalmaServer::sendAck(uint64_t dest_addr, uint16_t token, uint8_t *station_id, StatusCode status, AddrSet *set, uint16_t lifetime)
+void PalmaServer::sendAck(uint64_t dest_addr, uint16_t token, uint8_t *station_id, uint8_t station_id_len, StatusCode status, AddrSet *set, uint16_t lifetime)
 {
-	Packet pkt(MsgType::ACK, dest_addr, m_src_addr, token, status);
-	if(station_id != NULL)
-		pkt.addIdPar(ParType::STATION_ID, station_id);
-	if(set != NULL)
-	{
-		pkt.addMacSetPar(set);
-		pkt.addLifetimePar(lifetime);
-	}
-	m_netitf.netsend(&pkt);
+	int len = m_ack_tpl.fill(dest_addr, token, status, set, lifetime, station_id, station_id_len);
+	sendResponse(&m_ack_tpl, len);
 }
 
-void PalmaServer::processRelease(Packet *pkt)
+void PalmaServer::processRelease(PacketView *pkt)
 {
 	
 	AddrSet *released_set = pkt->getSet();
 	uint8_t * station_id = pkt->getStationId();
+	uint8_t station_id_len = pkt->getStationIdLen();
 	uint16_t token = pkt->getToken();
 	uint64_t src_addr = pkt->getSA();
-	uint64_t security_id;
 	uint16_t left_lifetime;
-	uint64_t assigned_security_id = getSecurityId(token, station_id, src_addr);
+	uint64_t assigned_security_id = getSecurityId(token, station_id, station_id_len, src_addr);
 	AddrSet src_addr_set(src_addr);
 	SetDatabase *db;
 	bool isMulticast = released_set->isMulticast();
@@ -328,27 +432,50 @@ void PalmaServer::processRelease(Packet *pkt)
 	
 	bool identical;
 	AssignableSet *result;
-	if(db->checkStatus(released_set, security_id, left_lifetime, identical, result) == DbStatus::ASSIGNED
-		&& security_id == assigned_security_id && identical)
+	if(db->checkLease(assigned_security_id, released_set, left_lifetime, identical, result) == DbStatus::ASSIGNED
+		&& identical)
 	{
 		db->release(result);
-		if(m_db_unicast.checkStatus(&src_addr_set, security_id, left_lifetime, identical, result) == DbStatus::ASSIGNED
-			&& security_id == assigned_security_id && identical)
+		if(m_db_unicast.checkLease(assigned_security_id, &src_addr_set, left_lifetime, identical, result) == DbStatus::ASSIGNED
+			&& identical)
 			m_db_unicast.release(result);
 	}
 }
 
-uint64_t PalmaServer::getSecurityId(uint16_t token, uint8_t *station_id, uint64_t src_addr)
+uint64_t PalmaServer::getSecurityId(uint16_t token, uint8_t *station_id, uint8_t station_id_len, uint64_t src_addr)
 {
 	m_hash.begin();
 	if(src_addr != 0)
 		m_hash.update(src_addr);
 	m_hash.update(token);
-	m_hash.update(station_id);
+	m_hash.update(station_id, station_id_len);
 	return m_hash.digest();
 }
 
+void PalmaServer::printPool(const char *name, SetDatabase *db)
+{
+	printf("POOL %s: nodes %lu/%lu (peak %lu), sets %lu/%lu (peak %lu), %lu slabs, %lu hugetlb\n", name,
+			db->m_node_pool.m_in_use, db->m_node_pool.m_capacity, db->m_node_pool.m_peak,
+			db->m_set_pool.m_in_use, db->m_set_pool.m_capacity, db->m_set_pool.m_peak,
+			db->m_node_pool.m_slabs + db->m_set_pool.m_slabs,
+			db->m_node_pool.m_hugetlb_slabs + db->m_set_pool.m_hugetlb_slabs);
+	printf("EXPIRY %s: %lu bursts, %lu leases, %lu rebuilds, burst mean %.3f ms, max %.3f ms\n", name,
+			db->m_expire_bursts, db->m_expired, db->m_expire_rebuilds,
+			db->m_expire_bursts ? db->m_expire_time * 1e3 / db->m_expire_bursts : 0., db->m_expire_max * 1e3);
+}
+
 void PalmaServer::onExit()
 {
+	printf("RX: %lu frames, %lu wakeups, %lu calls, %.2f frames/wakeup\n",
+			m_netitf.m_rx_frames, m_netitf.m_rx_wakeups, m_netitf.m_rx_calls,
+			m_netitf.m_rx_wakeups ? (double) m_netitf.m_rx_frames / m_netitf.m_rx_wakeups : 0.);
+	printf("CACHE: %lu hits, %lu misses, %lu re-offers\n", m_cache.m_hits, m_cache.m_misses, m_reoffers);
+	printPool("unicast", &m_db_unicast);
+	printPool("multicast", &m_db_multicast);
+	printPool("unicast_64", &m_db_unicast_64);
+	printPool("multicast_64", &m_db_multicast_64);
+	if(m_journal.isOpen())
+		printf("JOURNAL: %lu records, %lu commits, %lu stalls, %lu snapshots\n",
+				m_journal.m_records, m_journal.m_commits, m_journal.m_stalls, m_journal.m_snapshots);
 	printf("ENDING\n");
 }
@@ -7,6 +7,8 @@
 #include "../common/database.h"
 #include "../common/siphash.h"
 #include "../common/palma.h"
+#include "response-cache.h"
+#include "lease-journal.h"
 
 class PalmaServer : public Palma
 {
@@ -18,20 +20,34 @@ public:
 	SetDatabase m_db_multicast_64;
 	SipHash m_hash;
 	uint64_t m_src_addr;
+	PacketTemplate m_offer_tpl;
+	PacketTemplate m_ack_tpl;
+	ResponseCache m_cache;
+	uint64_t m_cache_key;
+	LeaseJournal m_journal;
+	uint64_t m_reoffers;
 
 	PalmaServer();
 	void begin();
-	void handlePacket(Packet *pkt);
+	void begin(Transport *transport);
+	void setup();
+	void initTemplates();
+	void handlePacket(PacketView *pkt);
+	bool replay(PacketView *pkt);
+	void sendResponse(PacketTemplate *tpl, int len);
 	bool defineSet(bool isMulticast, bool isSize64, SetDatabase *&db, 
 					uint64_t *max_addr = NULL, uint16_t *lifetime = NULL, bool *send_client_addr = NULL);
-	void processClaim(Packet *pkt);
+	void processClaim(PacketView *pkt);
+	bool reoffer(SetDatabase *db, uint64_t src_addr, uint16_t token, uint64_t security_id,
+						uint16_t lifetime, uint8_t *station_id, uint8_t station_id_len, bool send_client_addr);
 	void sendOffer(uint64_t dest_addr, uint16_t token, AddrSet *offer_set, 
-						uint16_t lifetime, uint8_t *station_id = NULL, AddrSet *client_addr = NULL);
-	void processRequest(Packet *pkt);
-	void sendAck(uint64_t dest_addr, uint16_t token, uint8_t *station_id, 
+						uint16_t lifetime, uint8_t *station_id = NULL, uint8_t station_id_len = 0, AddrSet *client_addr = NULL);
+	void processRequest(PacketView *pkt);
+	void sendAck(uint64_t dest_addr, uint16_t token, uint8_t *station_id, uint8_t station_id_len, 
 						StatusCode status, AddrSet *set = NULL, uint16_t lifetime = 0);
-	void processRelease(Packet *pkt);
-	uint64_t getSecurityId(uint16_t token, uint8_t *station_id, uint64_t src_addr = 0);
+	void processRelease(PacketView *pkt);
+	void printPool(const char *name, SetDatabase *db);
+	uint64_t getSecurityId(uint16_t token, uint8_t *station_id, uint8_t station_id_len, uint64_t src_addr = 0);
 	void onExit();
 };
 
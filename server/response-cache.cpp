@@ -0,0 +1,68 @@
+#include <string.h>
+#include "response-cache.h"
+#include "../common/details.h"
+#include "../common/timer.h"
+
+ResponseCache::ResponseCache() : m_hits(0), m_misses(0)
+{
+	m_entries = new Entry[RESPONSE_CACHE_SIZE];
+	memset(m_entries, 0, RESPONSE_CACHE_SIZE * sizeof(Entry));
+}
+
+ResponseCache::~ResponseCache()
+{
+	delete[] m_entries;
+}
+
+/* A client picks a new random SA from the DISCOVER range for every
+   DISCOVER it sends, so those sources are left out of the key. */
+
+uint64_t ResponseCache::key(PacketView *pkt)
+{
+	AddrSet src_addr_set(pkt->getSA());
+	AddrSet check_set;
+	AddrSet *set = pkt->getSet();
+
+	m_hash.begin();
+	m_hash.update((uint8_t) pkt->getType());
+	m_hash.update((uint8_t) pkt->getRenewal());
+	m_hash.update(pkt->getToken());
+	if(!check_set.checkConflict(&src_addr_set, &DISCOVER_SOURCE_ADDR_RANGE))
+		m_hash.update(pkt->getSA());
+	if(set != NULL)
+	{
+		m_hash.update(set->getFirstAddr());
+		m_hash.update(set->getSize());
+	}
+	m_hash.update(pkt->getStationId(), pkt->getStationIdLen());
+	uint64_t key = m_hash.digest();
+	return key ? key : 1;
+}
+
+uint8_t *ResponseCache::lookup(uint64_t key, uint64_t DA, uint16_t &len)
+{
+	Entry *entry = &m_entries[key & (RESPONSE_CACHE_SIZE - 1)];
+	Time now;
+
+	if(entry->m_key != key || entry->m_expire <= now.get())
+	{
+		m_misses++;
+		return NULL;
+	}
+	m_hits++;
+	uint8_t *p = entry->m_frame;
+	Packet::set64(DA, p, 6);
+	len = entry->m_len;
+	return entry->m_frame;
+}
+
+void ResponseCache::store(uint64_t key, uint8_t *frame, uint16_t len, double ttl)
+{
+	Entry *entry = &m_entries[key & (RESPONSE_CACHE_SIZE - 1)];
+	Time now;
+
+	entry->m_key = key;
+	entry->m_expire = now.get() + ttl;
+	entry->m_len = len;
+	memcpy(entry->m_frame, frame, len);
+}
@@ -0,0 +1,41 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <stdint.h>
+#include "../common/packet.h"
+#include "../common/siphash.h"
+
+#define RESPONSE_CACHE_SIZE	1024	/* power of 2 */
+
+/*
+ * Last response sent for each DISCOVER and REQUEST, so that client
+ * retransmissions are answered with the same OFFER/ACK instead of being
+ * processed again. Entries are direct mapped by a hash of the request and
+ * expire after the reserve lifetime.
+ */
+
+class ResponseCache
+{
+	struct Entry
+	{
+		uint64_t m_key;
+		double m_expire;
+		uint16_t m_len;
+		uint8_t m_frame[MAX_PKT_SIZE];
+	};
+
+	Entry *m_entries;
+	SipHash m_hash;
+
+public:
+	uint64_t m_hits;
+	uint64_t m_misses;
+
+	ResponseCache();
+	~ResponseCache();
+	uint64_t key(PacketView *pkt);
+	uint8_t *lookup(uint64_t key, uint64_t DA, uint16_t &len);
+	void store(uint64_t key, uint8_t *frame, uint16_t len, double ttl);
+};
+
+#endif
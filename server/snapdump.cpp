@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "../common/snapshot.h"
+
+/*
+ * Prints a lease snapshot written by palma-server, for inspection while
+ * the server is down or from a copy. Expiry times are shown relative to
+ * the moment the snapshot was taken.
+ */
+
+static const char *db_names[SNAPSHOT_MAX_DBS] = {"unicast", "multicast", "unicast_64", "multicast_64"};
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Uso:%s [-s] [-d <database>] <snapshot file>\n", name);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	bool summary = false;
+	int only_db = -1;
+	int c;
+
+	while((c = getopt(argc, argv, "sd:")) != -1)
+	{
+		switch(c)
+		{
+			case 's':
+				summary = true;
+				break;
+			case 'd':
+				only_db = atoi(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(optind != argc - 1)
+		usage(argv[0]);
+
+	const char *path = argv[optind];
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) < 0)
+	{
+		perror(path);
+		exit(1);
+	}
+	uint8_t *buf = st.st_size ? (uint8_t *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : (uint8_t *) MAP_FAILED;
+	close(fd);
+	if(buf == MAP_FAILED || !snapshotValid(buf, st.st_size))
+	{
+		fprintf(stderr, "%s: not a valid lease snapshot\n", path);
+		exit(1);
+	}
+
+	SnapshotHeader *h = (SnapshotHeader *) buf;
+	time_t taken = (time_t) h->m_time;
+	char date[64];
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&taken));
+	printf("%s: version %u, %u databases, seq %lu, taken %s, %lu bytes, key %016lx%016lx\n", path,
+			h->m_version, h->m_ndbs, h->m_seq, date, h->m_size, h->m_key[0], h->m_key[1]);
+
+	for(uint32_t i = 0; i < h->m_ndbs; i++)
+	{
+		if(only_db >= 0 && (uint32_t) only_db != i)
+			continue;
+		SnapshotDb *db = &h->m_db[i];
+		SnapshotLease *leases = (SnapshotLease *) (buf + db->m_offset);
+		uint64_t reserved = 0, addrs = 0;
+		for(uint64_t j = 0; j < db->m_leases; j++)
+		{
+			reserved += leases[j].m_reserved;
+			addrs += leases[j].m_count;
+		}
+		printf("%s: set 0x%012lx count %lu, %lu leases (%lu reserved), %lu addresses leased (%.2f%%)\n",
+				db_names[i], db->m_first, db->m_count, db->m_leases, reserved, addrs,
+				db->m_count ? 100. * addrs / db->m_count : 0.);
+		if(summary)
+			continue;
+		for(uint64_t j = 0; j < db->m_leases; j++)
+		{
+			SnapshotLease *l = &leases[j];
+			printf("\t0x%012lx-0x%012lx %8lu %-8s id %016lx expires %+.1f s\n", l->m_first,
+					l->m_first + l->m_count - 1, l->m_count, l->m_reserved ? "reserved" : "assigned",
+					l->m_security_id, l->m_expire - h->m_time);
+		}
+	}
+	munmap(buf, st.st_size);
+	return 0;
+}